@@ -1,8 +1,19 @@
+#include <algorithm>
 #include <atomic>
 #include <barrier>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <malloc.h>
+#include <memory>
 #include <mutex>
 #include <sys/mman.h>
 #include <thread>
+#include <type_traits>
+#include <unistd.h>
+#include <unordered_map>
 #include <vector>
 
 #include <benchmark/benchmark.h>
@@ -35,53 +46,164 @@ struct message_queue {
 	}
 };
 
+// Memory that an allocator holds, in bytes. What is counted depends on the allocator:
+// the frigg allocators count their mappings, mimalloc counts its committed memory
+// and the system allocator is measured by the resident set size of the process.
+struct memory_usage {
+	int64_t current;
+	int64_t peak;
+};
+
+// Counts the mappings and bytes that a policy has mapped.
+struct mapping_counters {
+	std::atomic<size_t> mappings{0};
+	std::atomic<size_t> bytes{0};
+	std::atomic<size_t> peak_bytes{0};
+
+	void map(size_t size) {
+		mappings.fetch_add(1, std::memory_order_relaxed);
+		size_t current = bytes.fetch_add(size, std::memory_order_relaxed) + size;
+		size_t peak = peak_bytes.load(std::memory_order_relaxed);
+		while (peak < current && !peak_bytes.compare_exchange_weak(peak, current,
+				std::memory_order_relaxed))
+			;
+	}
+
+	void unmap(size_t size) {
+		mappings.fetch_sub(1, std::memory_order_relaxed);
+		bytes.fetch_sub(size, std::memory_order_relaxed);
+	}
+
+	void reset_peak() {
+		peak_bytes.store(bytes.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	memory_usage usage() {
+		return {static_cast<int64_t>(bytes.load(std::memory_order_relaxed)),
+				static_cast<int64_t>(peak_bytes.load(std::memory_order_relaxed))};
+	}
+};
+
+// Resident set size of the process. The peak is VmHWM, which is reset by writing
+// to /proc/self/clear_refs; if that fails, it is the peak since the process started.
+static memory_usage process_memory() {
+	memory_usage usage{};
+	long size, resident;
+	if (FILE *file = fopen("/proc/self/statm", "r")) {
+		if (fscanf(file, "%ld %ld", &size, &resident) == 2)
+			usage.current = static_cast<int64_t>(resident) * sysconf(_SC_PAGESIZE);
+		fclose(file);
+	}
+	if (FILE *file = fopen("/proc/self/status", "r")) {
+		char line[256];
+		long kib;
+		while (fgets(line, sizeof(line), file)) {
+			if (sscanf(line, "VmHWM: %ld kB", &kib) == 1)
+				usage.peak = static_cast<int64_t>(kib) << 10;
+		}
+		fclose(file);
+	}
+	usage.peak = std::max(usage.peak, usage.current);
+	return usage;
+}
+
+static void reset_process_memory_peak() {
+	if (FILE *file = fopen("/proc/self/clear_refs", "w")) {
+		fputs("5", file);
+		fclose(file);
+	}
+}
+
 // Data structures for frg::slab_pool.
 
 struct slab_policy {
+	static inline mapping_counters counters;
+
 	uintptr_t map(size_t size) {
 		void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
 		                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 		if (ptr == MAP_FAILED)
 			return 0;
+		counters.map(size);
 		return reinterpret_cast<uintptr_t>(ptr);
 	}
 
 	void unmap(uintptr_t ptr, size_t size) {
 		munmap(reinterpret_cast<void *>(ptr), size);
+		counters.unmap(size);
 	}
 };
 
+// Same as slab_policy but buckets only take their mutex for slab state transitions.
+struct lock_free_slab_policy : slab_policy {
+	static constexpr bool lock_free_buckets = true;
+};
+
 slab_policy global_slab_policy;
 frg::slab_pool<slab_policy, std::mutex> global_slab_pool{global_slab_policy};
 
-struct slab_instance {
+lock_free_slab_policy global_lock_free_slab_policy;
+frg::slab_pool<lock_free_slab_policy, std::mutex> global_lock_free_slab_pool{
+	global_lock_free_slab_policy};
+
+template <auto &Pool>
+struct basic_slab_instance {
 	void *allocate(size_t size) {
-		return global_slab_pool.allocate(size);
+		return Pool.allocate(size);
 	}
 
 	void deallocate(void *ptr) {
-		global_slab_pool.free(ptr);
+		Pool.free(ptr);
+	}
+
+	void *reallocate(void *ptr, size_t size) {
+		return Pool.realloc(ptr, size);
+	}
+
+	size_t usable_size(void *ptr) {
+		return Pool.get_size(ptr);
+	}
+
+	frg::slab::extent_cache_stats large_cache_stats() {
+		return Pool.large_cache_stats();
+	}
+
+	static memory_usage memory() {
+		return slab_policy::counters.usage();
+	}
+
+	static void reset_memory_peak() {
+		slab_policy::counters.reset_peak();
 	}
 };
 
+using slab_instance = basic_slab_instance<global_slab_pool>;
+using lock_free_slab_instance = basic_slab_instance<global_lock_free_slab_pool>;
+
 // Data structures for frg::sharded_slab_pool.
 
 struct sharded_slab_policy {
+	// Mappings that currently exist in all pools.
+	static inline mapping_counters counters;
+
 	void *map(size_t size) {
 		void *ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
 		                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 		if (ptr == MAP_FAILED)
 			return nullptr;
+		counters.map(size);
 		return ptr;
 	}
 
 	void unmap(void *ptr, size_t size) {
 		munmap(ptr, size);
+		counters.unmap(size);
 	}
 };
 
-struct sharded_slab_instance {
-	frg::sharded_slab::pool<sharded_slab_policy> pool;
+template <typename Policy>
+struct basic_sharded_slab_instance {
+	frg::sharded_slab::pool<Policy> pool;
 
 	void *allocate(size_t size) {
 		return pool.allocate(size);
@@ -90,8 +212,110 @@ struct sharded_slab_instance {
 	void deallocate(void *ptr) {
 		pool.deallocate(ptr);
 	}
+
+	void *reallocate(void *ptr, size_t size) {
+		return pool.reallocate(ptr, size);
+	}
+
+	size_t usable_size(void *ptr) {
+		return pool.get_size(ptr);
+	}
+
+	size_t allocate_bulk(size_t size, frg::span<void *> ptrs) {
+		return pool.allocate_bulk(size, ptrs);
+	}
+
+	void deallocate_bulk(frg::span<void *> ptrs) {
+		pool.deallocate_bulk(ptrs);
+	}
+
+	frg::slab::extent_cache_stats large_cache_stats() {
+		return pool.large_cache_stats();
+	}
+
+	// Each chunk and each large allocation is a separate mapping
+	// (or a separate commit if chunks are taken from superblocks).
+	static size_t mapped_chunks() {
+		return Policy::counters.mappings.load(std::memory_order_relaxed);
+	}
+
+	static memory_usage memory() {
+		return Policy::counters.usage();
+	}
+
+	static void reset_memory_peak() {
+		Policy::counters.reset_peak();
+	}
+};
+
+using sharded_slab_instance = basic_sharded_slab_instance<sharded_slab_policy>;
+
+// Same as sharded_slab_policy but with four size classes per doubling.
+struct fine_sharded_slab_policy : sharded_slab_policy {
+	static constexpr unsigned int small_step_exp = 2;
+};
+
+using fine_sharded_slab_instance = basic_sharded_slab_instance<fine_sharded_slab_policy>;
+
+// Same as sharded_slab_policy but places a sample of all allocations on guarded pages.
+struct guarded_sharded_slab_policy : sharded_slab_policy {
+	static constexpr size_t guarded_sample_interval = 4096;
+
+	void protect(void *ptr, size_t size) {
+		mprotect(ptr, size, PROT_NONE);
+	}
+
+	void unprotect(void *ptr, size_t size) {
+		mprotect(ptr, size, PROT_READ | PROT_WRITE);
+	}
+};
+
+using guarded_sharded_slab_instance = basic_sharded_slab_instance<guarded_sharded_slab_policy>;
+
+// Same as sharded_slab_policy but takes chunks from superblocks.
+// The counters track committed memory (i.e., chunks and large extents) while the
+// superblocks are only counted as reserved. All large objects in these benchmarks are
+// small enough to be taken from superblocks.
+struct arena_sharded_slab_policy {
+	static inline mapping_counters counters;
+	static inline mapping_counters reserved;
+
+	void *map(size_t size, size_t alignment) {
+		// Over-allocate and trim to obtain an aligned mapping.
+		void *ptr = mmap(nullptr, size + alignment, PROT_READ | PROT_WRITE,
+		                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (ptr == MAP_FAILED)
+			return nullptr;
+		auto addr = reinterpret_cast<uintptr_t>(ptr);
+		auto aligned = (addr + alignment - 1) & ~(alignment - 1);
+		if (aligned != addr)
+			munmap(ptr, aligned - addr);
+		munmap(reinterpret_cast<void *>(aligned + size), addr + alignment - aligned);
+		reserved.map(size);
+		return reinterpret_cast<void *>(aligned);
+	}
+
+	void *map(size_t size) {
+		return map(size, 4096);
+	}
+
+	void unmap(void *ptr, size_t size) {
+		munmap(ptr, size);
+		reserved.unmap(size);
+	}
+
+	void commit(void *, size_t size) {
+		counters.map(size);
+	}
+
+	void decommit(void *ptr, size_t size) {
+		madvise(ptr, size, MADV_DONTNEED);
+		counters.unmap(size);
+	}
 };
 
+using arena_sharded_slab_instance = basic_sharded_slab_instance<arena_sharded_slab_policy>;
+
 // Data structures for system allocator.
 
 struct system_instance {
@@ -102,6 +326,22 @@ struct system_instance {
 	void deallocate(void *ptr) {
 		std::free(ptr);
 	}
+
+	void *reallocate(void *ptr, size_t size) {
+		return std::realloc(ptr, size);
+	}
+
+	size_t usable_size(void *ptr) {
+		return malloc_usable_size(ptr);
+	}
+
+	static memory_usage memory() {
+		return process_memory();
+	}
+
+	static void reset_memory_peak() {
+		reset_process_memory_peak();
+	}
 };
 
 // Data structures for mimalloc.
@@ -114,13 +354,146 @@ struct mimalloc_instance {
 	void deallocate(void *ptr) {
 		mi_free(ptr);
 	}
+
+	void *reallocate(void *ptr, size_t size) {
+		return mi_realloc(ptr, size);
+	}
+
+	size_t usable_size(void *ptr) {
+		return mi_usable_size(ptr);
+	}
+
+	// Resetting the statistics also resets the committed bytes, so the current
+	// value is relative to the last reset and can become negative.
+	static memory_usage memory() {
+		size_t current_commit, peak_commit;
+		mi_process_info(nullptr, nullptr, nullptr, nullptr, nullptr,
+				&current_commit, &peak_commit, nullptr);
+		return {static_cast<int64_t>(current_commit), static_cast<int64_t>(peak_commit)};
+	}
+
+	static void reset_memory_peak() {
+		mi_stats_reset();
+	}
+};
+
+// Total size of the objects that a benchmark has requested and not freed yet.
+// Threads update separate counters; their sum is sampled every few updates and after
+// each large allocation to find the peak.
+struct live_bytes {
+	static constexpr size_t num_counters = 64;
+	static constexpr size_t sample_interval = 64;
+	static constexpr int64_t sample_size = 4096;
+
+	static void allocated(size_t size) {
+		update_(static_cast<int64_t>(size));
+	}
+
+	static void freed(size_t size) {
+		update_(-static_cast<int64_t>(size));
+	}
+
+	static int64_t current() {
+		int64_t sum = 0;
+		for (auto &c : counters_)
+			sum += c.value.load(std::memory_order_relaxed);
+		return sum;
+	}
+
+	static int64_t peak() {
+		sample_();
+		return peak_.load(std::memory_order_relaxed);
+	}
+
+	// Must not be called while other threads update the counters.
+	static void reset() {
+		for (auto &c : counters_)
+			c.value.store(0, std::memory_order_relaxed);
+		peak_.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	struct alignas(64) counter {
+		std::atomic<int64_t> value;
+	};
+
+	static void update_(int64_t delta) {
+		thread_local size_t index = next_index_.fetch_add(1, std::memory_order_relaxed) % num_counters;
+		thread_local size_t updates = 0;
+		counters_[index].value.fetch_add(delta, std::memory_order_relaxed);
+		if (delta >= sample_size || !(++updates % sample_interval))
+			sample_();
+	}
+
+	static void sample_() {
+		int64_t sum = current();
+		int64_t peak = peak_.load(std::memory_order_relaxed);
+		while (peak < sum && !peak_.compare_exchange_weak(peak, sum, std::memory_order_relaxed))
+			;
+	}
+
+	static inline counter counters_[num_counters];
+	static inline std::atomic<int64_t> peak_{0};
+	static inline std::atomic<size_t> next_index_{0};
+};
+
+// Reports the peak and final memory of an instance relative to the start of
+// the benchmark, the peak of the live requested bytes, and the ratio of the peaks.
+// Construct it before the benchmark allocates anything and call finish() at the end.
+template <typename Instance>
+struct memory_report {
+	memory_report() {
+		live_bytes::reset();
+		Instance::reset_memory_peak();
+		baseline_ = Instance::memory().current;
+	}
+
+	void finish(benchmark::State &state) {
+		auto usage = Instance::memory();
+		int64_t peak = std::max(usage.peak, usage.current) - baseline_;
+		int64_t live = live_bytes::peak();
+		state.counters["mapped_peak"] = peak;
+		state.counters["mapped_final"] = usage.current - baseline_;
+		state.counters["live_peak"] = live;
+		state.counters["mapped_per_live"] = live > 0 ? static_cast<double>(peak) / live : 0;
+	}
+
+private:
+	int64_t baseline_;
 };
 
+// Batched operations. Fall back to individual calls if the instance does not support them.
+
+template <typename Instance>
+size_t allocate_bulk(Instance &instance, size_t size, frg::span<void *> ptrs) {
+	if constexpr (requires { instance.allocate_bulk(size, ptrs); }) {
+		return instance.allocate_bulk(size, ptrs);
+	} else {
+		for (size_t i = 0; i < ptrs.size(); i++) {
+			ptrs[i] = instance.allocate(size);
+			if (!ptrs[i])
+				return i;
+		}
+		return ptrs.size();
+	}
+}
+
+template <typename Instance>
+void deallocate_bulk(Instance &instance, frg::span<void *> ptrs) {
+	if constexpr (requires { instance.deallocate_bulk(ptrs); }) {
+		instance.deallocate_bulk(ptrs);
+	} else {
+		for (auto ptr : ptrs)
+			instance.deallocate(ptr);
+	}
+}
+
 template <typename Instance>
 static void BM_Allocators_MsgPass(benchmark::State &state) {
 	constexpr size_t objects_per_thread = 10000;
 
 	size_t num_threads = state.range(0);
+	memory_report<Instance> memory;
 
 	std::atomic<bool> running{true};
 	std::barrier<> iter_barrier(num_threads + 1);
@@ -143,6 +516,7 @@ static void BM_Allocators_MsgPass(benchmark::State &state) {
 			// Allocation phase: allocate objects and push to random queues.
 			for (size_t i = 0; i < objects_per_thread; i++) {
 				void *ptr = instance.allocate(sizeof(message_node));
+				live_bytes::allocated(sizeof(message_node));
 				auto *node = new (ptr) message_node{};
 				size_t target = rng(num_threads);
 				queues[target].push(node);
@@ -156,6 +530,7 @@ static void BM_Allocators_MsgPass(benchmark::State &state) {
 			while (node) {
 				message_node *next = node->next.load(std::memory_order_relaxed);
 				instance.deallocate(node);
+				live_bytes::freed(sizeof(message_node));
 				node = next;
 			}
 
@@ -188,25 +563,1122 @@ static void BM_Allocators_MsgPass(benchmark::State &state) {
 	for (auto &t : threads)
 		t.join();
 
+	memory.finish(state);
 	state.SetItemsProcessed(state.iterations() * num_threads * objects_per_thread);
 }
 
-BENCHMARK(BM_Allocators_MsgPass<slab_instance>)
-    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
-    ->Unit(benchmark::kMillisecond)
-    ->MeasureProcessCPUTime();
+template <typename Instance>
+static void BM_Allocators_MsgPassBatched(benchmark::State &state) {
+	constexpr size_t objects_per_thread = 10000;
+	constexpr size_t batch_size = 32;
 
-BENCHMARK(BM_Allocators_MsgPass<sharded_slab_instance>)
-    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
-    ->Unit(benchmark::kMillisecond)
-    ->MeasureProcessCPUTime();
+	size_t num_threads = state.range(0);
+	memory_report<Instance> memory;
 
-BENCHMARK(BM_Allocators_MsgPass<system_instance>)
-    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
-    ->Unit(benchmark::kMillisecond)
-    ->MeasureProcessCPUTime();
+	std::atomic<bool> running{true};
+	std::barrier<> iter_barrier(num_threads + 1);
+	std::barrier<> done_barrier(num_threads + 1);
+	std::barrier<> phase_barrier(num_threads);
+	std::vector<message_queue> queues(num_threads);
 
-BENCHMARK(BM_Allocators_MsgPass<mimalloc_instance>)
-    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
-    ->Unit(benchmark::kMillisecond)
-    ->MeasureProcessCPUTime();
+	auto thread_main = [&] (size_t thread_id) {
+		Instance instance;
+		frg::pcg_basic32 rng(0);
+		void *batch[batch_size];
+		size_t pass = 0;
+
+		while (true) {
+			iter_barrier.arrive_and_wait();
+			if (!running.load(std::memory_order_relaxed))
+				break;
+			rng.seed(thread_id + pass * num_threads);
+			pass++;
+
+			// Allocation phase: allocate batches of objects and push them to random queues.
+			for (size_t i = 0; i < objects_per_thread; i += batch_size) {
+				size_t n = std::min(batch_size, objects_per_thread - i);
+				if (allocate_bulk(instance, sizeof(message_node), {batch, n}) != n)
+					abort();
+				live_bytes::allocated(n * sizeof(message_node));
+				for (size_t j = 0; j < n; j++) {
+					auto *node = new (batch[j]) message_node{};
+					size_t target = rng(num_threads);
+					queues[target].push(node);
+				}
+			}
+
+			// Wait for all threads to finish allocation.
+			phase_barrier.arrive_and_wait();
+
+			// Deallocation phase: free all objects from our own queue in batches.
+			message_node *node = queues[thread_id].pop_all();
+			size_t n = 0;
+			while (node) {
+				message_node *next = node->next.load(std::memory_order_relaxed);
+				batch[n++] = node;
+				if (n == batch_size) {
+					deallocate_bulk(instance, {batch, n});
+					live_bytes::freed(n * sizeof(message_node));
+					n = 0;
+				}
+				node = next;
+			}
+			deallocate_bulk(instance, {batch, n});
+			live_bytes::freed(n * sizeof(message_node));
+
+			done_barrier.arrive_and_wait();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < num_threads; i++)
+		threads.emplace_back(thread_main, i);
+
+	auto iteration = [&] {
+		// Signal workers to start.
+		iter_barrier.arrive_and_wait();
+		// Wait for workers to finish this iteration.
+		done_barrier.arrive_and_wait();
+	};
+
+	// Warm up.
+	for (size_t i = 0; i < 3; ++i)
+		iteration();
+	// Timed benchmark.
+	for (auto _ : state)
+		iteration();
+
+	// Signal workers to terminate.
+	running.store(false, std::memory_order_relaxed);
+	iter_barrier.arrive_and_wait();
+
+	for (auto &t : threads)
+		t.join();
+
+	memory.finish(state);
+	state.SetItemsProcessed(state.iterations() * num_threads * objects_per_thread);
+}
+
+// All threads allocate and free batches of objects of the same size,
+// such that they contend on a single bucket.
+template <typename Instance>
+static void BM_Allocators_ContendedBucket(benchmark::State &state) {
+	constexpr size_t objects_per_thread = 10000;
+	constexpr size_t batch_size = 16;
+	constexpr size_t object_size = 64;
+
+	size_t num_threads = state.range(0);
+	memory_report<Instance> memory;
+
+	std::atomic<bool> running{true};
+	std::barrier<> iter_barrier(num_threads + 1);
+	std::barrier<> done_barrier(num_threads + 1);
+
+	auto thread_main = [&] {
+		Instance instance;
+		void *batch[batch_size];
+
+		while (true) {
+			iter_barrier.arrive_and_wait();
+			if (!running.load(std::memory_order_relaxed))
+				break;
+
+			for (size_t i = 0; i < objects_per_thread; i += batch_size) {
+				for (auto &ptr : batch) {
+					ptr = instance.allocate(object_size);
+					live_bytes::allocated(object_size);
+				}
+				for (auto ptr : batch) {
+					instance.deallocate(ptr);
+					live_bytes::freed(object_size);
+				}
+			}
+
+			done_barrier.arrive_and_wait();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < num_threads; i++)
+		threads.emplace_back(thread_main);
+
+	auto iteration = [&] {
+		// Signal workers to start.
+		iter_barrier.arrive_and_wait();
+		// Wait for workers to finish this iteration.
+		done_barrier.arrive_and_wait();
+	};
+
+	// Warm up.
+	for (size_t i = 0; i < 3; ++i)
+		iteration();
+	// Timed benchmark.
+	for (auto _ : state)
+		iteration();
+
+	// Signal workers to terminate.
+	running.store(false, std::memory_order_relaxed);
+	iter_barrier.arrive_and_wait();
+
+	for (auto &t : threads)
+		t.join();
+
+	memory.finish(state);
+	state.SetItemsProcessed(state.iterations() * num_threads * objects_per_thread * 2);
+}
+
+// Latencies of a sample of operations. Timing every operation would distort
+// the throughput, so by default only every 16th operation is timed.
+struct latency_recorder {
+	size_t interval = 16;
+	std::vector<uint32_t> samples;
+
+	template <typename F>
+	auto operator()(F f) {
+		if (++count_ % interval)
+			return f();
+
+		auto start = std::chrono::steady_clock::now();
+		if constexpr (std::is_void_v<decltype(f())>) {
+			f();
+			record_(start);
+		} else {
+			auto result = f();
+			record_(start);
+			return result;
+		}
+	}
+
+private:
+	void record_(std::chrono::steady_clock::time_point start) {
+		auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				std::chrono::steady_clock::now() - start).count();
+		samples.push_back(std::min<int64_t>(ns, UINT32_MAX));
+	}
+
+	size_t count_ = 0;
+};
+
+// An object together with its requested size, for live_bytes.
+struct sized_object {
+	void *ptr = nullptr;
+	size_t size = 0;
+};
+
+// Replaces an object by a new object of the given size.
+template <typename Instance>
+static void replace_object(Instance &instance, latency_recorder &latencies,
+		sized_object &object, size_t size) {
+	if (object.ptr) {
+		latencies([&] { instance.deallocate(object.ptr); });
+		live_bytes::freed(object.size);
+	}
+	object.ptr = latencies([&] { return instance.allocate(size); });
+	object.size = size;
+	live_bytes::allocated(size);
+}
+
+template <typename Instance>
+static void free_object(Instance &instance, sized_object &object) {
+	if (!object.ptr)
+		return;
+	instance.deallocate(object.ptr);
+	live_bytes::freed(object.size);
+	object = {};
+}
+
+// Runs a workload on num_threads threads that each have their own Instance.
+// body(thread_id, instance, latencies, pass) is called on each thread in each iteration;
+// teardown(thread_id, instance) is called on each thread before it exits.
+// Reports the median and 99th percentile of the latencies of all threads, and the memory
+// usage; the body and teardown must report their allocations and frees to live_bytes.
+template <typename Instance, typename Body, typename Teardown>
+static void run_workload(benchmark::State &state, size_t num_threads, Body body, Teardown teardown) {
+	memory_report<Instance> memory;
+	std::atomic<bool> running{true};
+	std::barrier<> iter_barrier(num_threads + 1);
+	std::barrier<> done_barrier(num_threads + 1);
+	std::vector<latency_recorder> latencies(num_threads);
+
+	auto thread_main = [&] (size_t thread_id) {
+		Instance instance;
+		size_t pass = 0;
+
+		while (true) {
+			iter_barrier.arrive_and_wait();
+			if (!running.load(std::memory_order_relaxed))
+				break;
+			body(thread_id, instance, latencies[thread_id], pass++);
+			done_barrier.arrive_and_wait();
+		}
+
+		teardown(thread_id, instance);
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < num_threads; i++)
+		threads.emplace_back(thread_main, i);
+
+	auto iteration = [&] {
+		// Signal workers to start.
+		iter_barrier.arrive_and_wait();
+		// Wait for workers to finish this iteration.
+		done_barrier.arrive_and_wait();
+	};
+
+	// Warm up.
+	iteration();
+	for (auto &l : latencies)
+		l.samples.clear();
+	// Timed benchmark.
+	for (auto _ : state)
+		iteration();
+
+	// Signal workers to terminate.
+	running.store(false, std::memory_order_relaxed);
+	iter_barrier.arrive_and_wait();
+
+	for (auto &t : threads)
+		t.join();
+
+	memory.finish(state);
+	std::vector<uint32_t> samples;
+	for (auto &l : latencies)
+		samples.insert(samples.end(), l.samples.begin(), l.samples.end());
+	if (samples.empty())
+		return;
+	auto percentile = [&] (size_t p) {
+		auto it = samples.begin() + (samples.size() - 1) * p / 100;
+		std::nth_element(samples.begin(), it, samples.end());
+		return *it;
+	};
+	state.counters["p50_ns"] = percentile(50);
+	state.counters["p99_ns"] = percentile(99);
+}
+
+// Larson-style server churn: each thread replaces random objects of random sizes
+// in an array of objects. Between iterations, the arrays are passed on to the next thread,
+// such that threads free objects that were allocated by other threads.
+template <typename Instance>
+static void BM_Allocators_Larson(benchmark::State &state) {
+	constexpr size_t objects_per_thread = 1024;
+	constexpr size_t replacements = 10000;
+	constexpr size_t min_size = 16;
+	constexpr size_t max_size = 1024;
+
+	size_t num_threads = state.range(0);
+	std::vector<std::vector<sized_object>> arrays(num_threads,
+			std::vector<sized_object>(objects_per_thread));
+
+	run_workload<Instance>(state, num_threads,
+		[&] (size_t thread_id, Instance &instance, latency_recorder &latencies, size_t pass) {
+			auto &objects = arrays[(thread_id + pass) % num_threads];
+			frg::pcg_basic32 rng(thread_id + pass * num_threads);
+
+			for (size_t i = 0; i < replacements; i++) {
+				auto &object = objects[rng(objects_per_thread)];
+				size_t size = min_size + rng(max_size - min_size + 1);
+				replace_object(instance, latencies, object, size);
+			}
+		},
+		[&] (size_t thread_id, Instance &instance) {
+			for (auto &object : arrays[thread_id])
+				free_object(instance, object);
+		});
+
+	state.SetItemsProcessed(state.iterations() * num_threads * replacements * 2);
+}
+
+// xmalloc-style producer/consumer: even threads allocate objects and pass them to
+// the next odd thread, which frees them. Requires an even number of threads.
+template <typename Instance>
+static void BM_Allocators_ProducerConsumer(benchmark::State &state) {
+	constexpr size_t objects_per_producer = 10000;
+	constexpr size_t max_size = 512;
+
+	struct sized_node : message_node {
+		size_t size;
+	};
+
+	size_t num_threads = state.range(0);
+	std::vector<message_queue> queues(num_threads / 2);
+
+	run_workload<Instance>(state, num_threads,
+		[&] (size_t thread_id, Instance &instance, latency_recorder &latencies, size_t pass) {
+			auto &queue = queues[thread_id / 2];
+			if (!(thread_id & 1)) {
+				frg::pcg_basic32 rng(thread_id + pass * num_threads);
+				for (size_t i = 0; i < objects_per_producer; i++) {
+					size_t size = sizeof(sized_node) + rng(max_size - sizeof(sized_node) + 1);
+					void *ptr = latencies([&] { return instance.allocate(size); });
+					live_bytes::allocated(size);
+					auto *node = new (ptr) sized_node{};
+					node->size = size;
+					queue.push(node);
+				}
+				return;
+			}
+
+			size_t freed = 0;
+			while (freed < objects_per_producer) {
+				message_node *node = queue.pop_all();
+				if (!node) {
+					std::this_thread::yield();
+					continue;
+				}
+				while (node) {
+					message_node *next = node->next.load(std::memory_order_relaxed);
+					live_bytes::freed(static_cast<sized_node *>(node)->size);
+					latencies([&] { instance.deallocate(node); });
+					node = next;
+					freed++;
+				}
+			}
+		},
+		[] (size_t, Instance &) { });
+
+	state.SetItemsProcessed(state.iterations() * num_threads * objects_per_producer);
+}
+
+// Allocates and frees short-lived objects of random sizes while each thread
+// holds a long-lived working set of objects, of which a few are replaced over time.
+template <typename Instance>
+static void BM_Allocators_WorkingSet(benchmark::State &state) {
+	constexpr size_t working_set = 4096;
+	constexpr size_t short_lived = 64;
+	constexpr size_t ops = 10000;
+	constexpr size_t min_size = 16;
+	constexpr size_t max_size = 4096;
+
+	size_t num_threads = state.range(0);
+	std::vector<std::vector<sized_object>> long_objects(num_threads);
+	std::vector<std::vector<sized_object>> short_objects(num_threads);
+
+	run_workload<Instance>(state, num_threads,
+		[&] (size_t thread_id, Instance &instance, latency_recorder &latencies, size_t pass) {
+			frg::pcg_basic32 rng(thread_id + pass * num_threads);
+			auto random_size = [&] {
+				return min_size + rng(max_size - min_size + 1);
+			};
+
+			auto &long_lived = long_objects[thread_id];
+			auto &ring = short_objects[thread_id];
+			if (!pass) {
+				long_lived.resize(working_set);
+				for (auto &object : long_lived) {
+					size_t size = random_size();
+					object = {instance.allocate(size), size};
+					live_bytes::allocated(size);
+				}
+				ring.resize(short_lived);
+			}
+
+			for (size_t i = 0; i < ops; i++) {
+				// Replace one in 32 objects of the working set, otherwise the oldest short-lived object.
+				auto &object = rng(32) ? ring[i % short_lived] : long_lived[rng(working_set)];
+				replace_object(instance, latencies, object, random_size());
+			}
+		},
+		[&] (size_t thread_id, Instance &instance) {
+			for (auto &object : long_objects[thread_id])
+				free_object(instance, object);
+			for (auto &object : short_objects[thread_id])
+				free_object(instance, object);
+		});
+
+	state.SetItemsProcessed(state.iterations() * num_threads * ops * 2);
+}
+
+// Grows buffers from 16 bytes to 1 MiB by repeated reallocation, like a growing
+// string or vector would. Reports the latency per reallocation.
+template <typename Instance>
+static void BM_Allocators_ReallocChains(benchmark::State &state) {
+	constexpr size_t chains = 64;
+	constexpr size_t initial_size = 16;
+	constexpr size_t max_size = 1 << 20;
+	constexpr size_t steps = [] {
+		size_t n = 0;
+		for (size_t size = initial_size; size < max_size; size += size / 2 + 8)
+			n++;
+		return n;
+	}();
+
+	size_t num_threads = state.range(0);
+
+	run_workload<Instance>(state, num_threads,
+		[&] (size_t, Instance &instance, latency_recorder &latencies, size_t) {
+			for (size_t i = 0; i < chains; i++) {
+				size_t size = initial_size;
+				auto *ptr = static_cast<char *>(instance.allocate(size));
+				live_bytes::allocated(size);
+				while (size < max_size) {
+					size_t new_size = size + size / 2 + 8;
+					ptr = static_cast<char *>(latencies([&] { return instance.reallocate(ptr, new_size); }));
+					live_bytes::allocated(new_size - size);
+					size = new_size;
+					// Write to the end of the buffer like an append would.
+					ptr[size - 1] = 0;
+				}
+				instance.deallocate(ptr);
+				live_bytes::freed(size);
+			}
+		},
+		[] (size_t, Instance &) { });
+
+	state.SetItemsProcessed(state.iterations() * num_threads * chains * steps);
+}
+
+// Replaces random objects of a live set, where one in 32 objects is large (64 KiB to 1 MiB)
+// and the others are small (16 to 512 bytes).
+template <typename Instance>
+static void BM_Allocators_MixedSizes(benchmark::State &state) {
+	constexpr size_t num_live = 256;
+	constexpr size_t replacements = 10000;
+
+	size_t num_threads = state.range(0);
+	std::vector<std::vector<sized_object>> arrays(num_threads, std::vector<sized_object>(num_live));
+
+	run_workload<Instance>(state, num_threads,
+		[&] (size_t thread_id, Instance &instance, latency_recorder &latencies, size_t pass) {
+			frg::pcg_basic32 rng(thread_id + pass * num_threads);
+			auto &objects = arrays[thread_id];
+
+			for (size_t i = 0; i < replacements; i++) {
+				auto &object = objects[rng(num_live)];
+				size_t size = rng(32) ? 16 + rng(512 - 16 + 1) : (64 << 10) + rng((1 << 20) - (64 << 10) + 1);
+				replace_object(instance, latencies, object, size);
+				// Touch the object.
+				*static_cast<char *>(object.ptr) = 0;
+			}
+		},
+		[&] (size_t thread_id, Instance &instance) {
+			for (auto &object : arrays[thread_id])
+				free_object(instance, object);
+		});
+
+	state.SetItemsProcessed(state.iterations() * num_threads * replacements * 2);
+}
+
+// Measures the first allocation of several sizes from a fresh instance, which needs to
+// create a chunk (or slab) for each size. Instances that share a global heap do not
+// start out empty; for them, this measures allocations after all objects were freed.
+template <typename Instance>
+static void BM_Allocators_FirstAllocation(benchmark::State &state) {
+	constexpr size_t sizes[] = {16, 64, 256, 1024, 4096, 16384};
+
+	size_t num_threads = state.range(0);
+
+	run_workload<Instance>(state, num_threads,
+		[&] (size_t, Instance &, latency_recorder &latencies, size_t) {
+			Instance fresh;
+			void *objects[std::size(sizes)];
+
+			latencies.interval = 1;
+			for (size_t i = 0; i < std::size(sizes); i++) {
+				objects[i] = latencies([&] { return fresh.allocate(sizes[i]); });
+				live_bytes::allocated(sizes[i]);
+			}
+			for (size_t i = 0; i < std::size(sizes); i++) {
+				fresh.deallocate(objects[i]);
+				live_bytes::freed(sizes[i]);
+			}
+		},
+		[] (size_t, Instance &) { });
+
+	state.SetItemsProcessed(state.iterations() * num_threads * std::size(sizes));
+}
+
+// Repeatedly grows the working set and then frees most objects in random order,
+// followed by random replacements. Reports the number of chunks in steady state.
+template <typename Instance>
+static void BM_Allocators_Fragmentation(benchmark::State &state) {
+	constexpr size_t object_size = 64;
+	constexpr size_t num_live = 1 << 14;
+	constexpr size_t growth = 8;
+	constexpr size_t replacements = 100000;
+
+	memory_report<Instance> memory;
+	Instance instance;
+	frg::pcg_basic32 rng(0);
+	std::vector<void *> objects;
+	size_t baseline = Instance::mapped_chunks();
+
+	for (auto _ : state) {
+		while (objects.size() < growth * num_live) {
+			objects.push_back(instance.allocate(object_size));
+			live_bytes::allocated(object_size);
+		}
+		for (size_t i = objects.size() - 1; i > 0; i--)
+			std::swap(objects[i], objects[rng(i + 1)]);
+		while (objects.size() > num_live) {
+			instance.deallocate(objects.back());
+			live_bytes::freed(object_size);
+			objects.pop_back();
+		}
+
+		// The number of live objects does not change here.
+		for (size_t i = 0; i < replacements; i++) {
+			size_t k = rng(num_live);
+			instance.deallocate(objects[k]);
+			objects[k] = instance.allocate(object_size);
+		}
+	}
+
+	state.counters["chunks"] = Instance::mapped_chunks() - baseline;
+	state.SetItemsProcessed(state.iterations() * ((growth - 1) * num_live * 2 + replacements * 2));
+
+	for (auto ptr : objects)
+		instance.deallocate(ptr);
+	memory.finish(state);
+}
+
+BENCHMARK(BM_Allocators_Fragmentation<sharded_slab_instance>)
+    ->Iterations(20)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Allocators_Fragmentation<arena_sharded_slab_instance>)
+    ->Iterations(20)
+    ->Unit(benchmark::kMillisecond);
+
+// Allocates and frees buffers between 40 KiB and 1 MiB, keeping a few of them live.
+template <typename Instance>
+static void BM_Allocators_LargeBuffers(benchmark::State &state) {
+	constexpr size_t min_size = 40 << 10;
+	constexpr size_t max_size = 1 << 20;
+	constexpr size_t num_live = 4;
+
+	memory_report<Instance> memory;
+	Instance instance;
+	frg::pcg_basic32 rng(0);
+	void *live[num_live] = {};
+	size_t live_sizes[num_live] = {};
+	size_t k = 0;
+
+	frg::slab::extent_cache_stats initial_stats{};
+	if constexpr (requires { instance.large_cache_stats(); })
+		initial_stats = instance.large_cache_stats();
+
+	for (auto _ : state) {
+		size_t size = min_size + rng(max_size - min_size + 1);
+		instance.deallocate(live[k]);
+		live_bytes::freed(live_sizes[k]);
+		live[k] = instance.allocate(size);
+		live_sizes[k] = size;
+		live_bytes::allocated(size);
+		// Touch the buffer like an I/O operation would.
+		memset(live[k], 0, 4096);
+		benchmark::DoNotOptimize(live[k]);
+		k = (k + 1) % num_live;
+	}
+
+	for (auto ptr : live)
+		instance.deallocate(ptr);
+	memory.finish(state);
+
+	if constexpr (requires { instance.large_cache_stats(); }) {
+		auto stats = instance.large_cache_stats();
+		size_t hits = stats.hits - initial_stats.hits;
+		size_t misses = stats.misses - initial_stats.misses;
+		state.counters["hit_rate"] = hits + misses ? static_cast<double>(hits) / (hits + misses) : 0;
+	}
+	state.SetItemsProcessed(state.iterations());
+}
+
+// Allocates objects whose sizes follow a realistic distribution and reports
+// the bytes consumed (i.e., the usable size of each object) vs. the bytes requested.
+// Distribution 0 is log-uniform between 8 bytes and 32 KiB.
+// Distribution 1 consists of typical sizes of structs, strings and buffers.
+template <typename Instance>
+static void BM_Allocators_SizeClasses(benchmark::State &state) {
+	constexpr size_t num_live = 1 << 12;
+	constexpr size_t typical_sizes[] = {
+		16, 24, 24, 32, 40, 48, 48, 56, 72, 80, 96, 112, 136, 160,
+		200, 264, 320, 392, 520, 640, 1100, 1500, 2100, 4200, 5000, 9000
+	};
+
+	memory_report<Instance> memory;
+	Instance instance;
+	frg::pcg_basic32 rng(0);
+	std::vector<void *> objects(num_live);
+	std::vector<size_t> sizes(num_live);
+	uint64_t requested = 0;
+	uint64_t consumed = 0;
+
+	auto next_size = [&] () -> size_t {
+		if (state.range(0) == 0) {
+			unsigned int e = 3 + rng(12);
+			return (size_t{1} << e) + rng(uint32_t{1} << e);
+		}
+		return typical_sizes[rng(std::size(typical_sizes))];
+	};
+
+	for (auto _ : state) {
+		for (size_t i = 0; i < num_live; i++) {
+			size_t size = next_size();
+			objects[i] = instance.allocate(size);
+			sizes[i] = size;
+			live_bytes::allocated(size);
+			requested += size;
+			consumed += instance.usable_size(objects[i]);
+		}
+		for (size_t i = 0; i < num_live; i++) {
+			instance.deallocate(objects[i]);
+			live_bytes::freed(sizes[i]);
+		}
+	}
+	memory.finish(state);
+
+	state.counters["consumed_per_requested"] = requested
+			? static_cast<double>(consumed) / requested : 0;
+	state.SetItemsProcessed(state.iterations() * num_live);
+}
+
+// An object that is expensive to construct, like a kernel thread or descriptor.
+struct constructed_object {
+	constructed_object() {
+		memset(registers, 0, sizeof(registers));
+		for (size_t i = 0; i < std::size(slots); i++)
+			slots[i] = i;
+	}
+
+	void reset() {
+		state = 0;
+	}
+
+	uint64_t state{0};
+	uint64_t registers[16];
+	uint32_t slots[12];
+};
+
+// Allocates and frees objects of a fixed type, either from the pool (constructing and
+// destructing them every time) or from an object cache that keeps them constructed.
+// Arg 0 uses frg::sharded_slab::pool, arg 1 uses frg::sharded_slab::object_cache.
+static void BM_Allocators_ObjectCache(benchmark::State &state) {
+	constexpr size_t num_live = 32;
+
+	using pool_type = frg::sharded_slab::pool<sharded_slab_policy>;
+	pool_type pool;
+	frg::sharded_slab::object_cache<constructed_object, sharded_slab_policy> cache{pool};
+	constructed_object *objects[num_live];
+
+	auto allocate = [&] () -> constructed_object * {
+		if (state.range(0))
+			return cache.allocate();
+		return new (pool.allocate(sizeof(constructed_object))) constructed_object();
+	};
+	auto deallocate = [&] (constructed_object *obj) {
+		if (state.range(0)) {
+			cache.deallocate(obj);
+			return;
+		}
+		obj->~constructed_object();
+		pool.deallocate(obj);
+	};
+
+	for (auto _ : state) {
+		for (size_t i = 0; i < num_live; i++) {
+			objects[i] = allocate();
+			benchmark::DoNotOptimize(objects[i]);
+		}
+		for (size_t i = 0; i < num_live; i++)
+			deallocate(objects[i]);
+	}
+
+	auto obj = allocate();
+	state.counters["consumed_per_requested"] = static_cast<double>(pool.get_size(obj))
+			/ sizeof(constructed_object);
+	deallocate(obj);
+	state.SetItemsProcessed(state.iterations() * num_live);
+}
+
+// A trace recorded by frg::slab::trace(), prepared for replaying.
+// Pointers are mapped to slots at load time, so replaying does not need to look them up.
+struct replay_trace {
+	struct op {
+		uint32_t slot;
+		// Index of the op among all ops on the slot.
+		uint32_t seq;
+		size_t size;
+		bool free;
+		// Whether this is the last op on the slot.
+		bool last;
+	};
+
+	// Returns an error message on failure.
+	const char *load(const char *path) {
+		std::vector<uint8_t> data;
+		FILE *file = fopen(path, "rb");
+		if (!file)
+			return "failed to open trace";
+		uint8_t buffer[1 << 16];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), file)))
+			data.insert(data.end(), buffer, buffer + n);
+		fclose(file);
+
+		size_t i = 0;
+		auto read_word = [&] {
+			uint64_t val = 0;
+			for (int k = 0; k < 8 && i < data.size(); k++)
+				val |= uint64_t(data[i++]) << (k * 8);
+			return val;
+		};
+		auto read_varint = [&] {
+			uint64_t val = 0;
+			for (int shift = 0; i < data.size() && shift < 64; shift += 7) {
+				uint8_t byte = data[i++];
+				val |= uint64_t(byte & 0x7F) << shift;
+				if (!(byte & 0x80))
+					break;
+			}
+			return val;
+		};
+		auto read_delta = [&] (uint64_t prev) {
+			uint64_t zigzag = read_varint();
+			return prev + ((zigzag >> 1) ^ -(zigzag & 1));
+		};
+
+		int version = 1;
+		if (data.size() >= 4 && !memcmp(data.data(), "FRGT", 4)) {
+			i = 4;
+			version = read_varint();
+			if (version != 2)
+				return "unsupported trace format version";
+		}
+
+		struct live_object {
+			uint32_t slot;
+			size_t thread;
+			size_t size;
+		};
+
+		std::unordered_map<uintptr_t, live_object> live;
+		std::vector<uint32_t> free_slots;
+		size_t thread = 0;
+		uint64_t prev_ptr = 0;
+
+		std::vector<uint32_t> slot_ops;
+		std::vector<std::pair<size_t, size_t>> last_ops;
+
+		auto emit = [&] (size_t t, uint32_t slot, bool free, size_t size) {
+			if (threads.size() <= t)
+				threads.resize(t + 1);
+			if (slot_ops.size() <= slot) {
+				slot_ops.resize(slot + 1);
+				last_ops.resize(slot + 1);
+			}
+			threads[t].push_back({slot, slot_ops[slot]++, size, free, false});
+			last_ops[slot] = {t, threads[t].size() - 1};
+			num_ops++;
+		};
+
+		while (i < data.size()) {
+			char c = data[i++];
+			uintptr_t ptr;
+			size_t size = 0;
+			if (version == 2) {
+				if (c == 'i')
+					return "sampled traces cannot be replayed";
+				if (c == 't') {
+					thread = read_varint();
+					continue;
+				}
+				ptr = prev_ptr = read_delta(prev_ptr);
+				if (c == 'a')
+					size = read_varint();
+				if (read_varint() & 1) {
+					for (uint64_t k = read_varint(); k; k--)
+						read_varint();
+				}
+			} else {
+				ptr = read_word();
+				if (c == 'a')
+					size = read_word();
+				while (i < data.size() && read_word() != 0xA5A5A5A5A5A5A5A5)
+					;
+				if (c == 'i')
+					return "sampled traces cannot be replayed";
+			}
+
+			// Skip double allocations and frees of unknown pointers, like slab_trace_analyzer.
+			if (c == 'a') {
+				if (!ptr || live.contains(ptr))
+					continue;
+				uint32_t slot;
+				if (free_slots.empty()) {
+					slot = num_slots++;
+				} else {
+					slot = free_slots.back();
+					free_slots.pop_back();
+				}
+				size = std::max(size, size_t{1});
+				live[ptr] = {slot, thread, size};
+				emit(thread, slot, false, size);
+			} else {
+				auto it = live.find(ptr);
+				if (it == live.end())
+					continue;
+				emit(thread, it->second.slot, true, it->second.size);
+				free_slots.push_back(it->second.slot);
+				live.erase(it);
+			}
+		}
+
+		// Free leaked objects on the threads that allocated them,
+		// such that each replay starts with an empty heap.
+		for (auto &[ptr, object] : live)
+			emit(object.thread, object.slot, true, object.size);
+		for (auto [t, k] : last_ops)
+			threads[t][k].last = true;
+
+		if (!num_ops)
+			return "trace is empty";
+		return nullptr;
+	}
+
+	// Ops of each thread of the trace, in trace order.
+	std::vector<std::vector<op>> threads;
+	size_t num_slots = 0;
+	size_t num_ops = 0;
+};
+
+// Replays the allocations and frees of a trace with their original sizes.
+// Each thread of the trace is replayed on its own thread. Objects are passed
+// between threads through slots; ops on the same slot are executed in trace order.
+template <typename Instance>
+static void BM_Allocators_Replay(benchmark::State &state, const replay_trace *trace) {
+	size_t num_threads = trace->threads.size();
+	memory_report<Instance> memory;
+
+	std::atomic<bool> running{true};
+	std::barrier<> iter_barrier(num_threads + 1);
+	std::barrier<> done_barrier(num_threads + 1);
+	struct slot {
+		// Number of ops on the slot that were executed in the current iteration.
+		std::atomic<uint32_t> seq{0};
+		void *ptr{nullptr};
+	};
+
+	auto slots = std::make_unique<slot[]>(trace->num_slots);
+
+	auto thread_main = [&] (size_t thread_id) {
+		Instance instance;
+
+		while (true) {
+			iter_barrier.arrive_and_wait();
+			if (!running.load(std::memory_order_relaxed))
+				break;
+
+			for (auto &op : trace->threads[thread_id]) {
+				auto &s = slots[op.slot];
+				// Wait for the previous op on the slot. This never blocks for single-threaded traces.
+				uint32_t seq;
+				while ((seq = s.seq.load(std::memory_order_acquire)) != op.seq)
+					s.seq.wait(seq, std::memory_order_acquire);
+
+				if (op.free) {
+					instance.deallocate(s.ptr);
+					live_bytes::freed(op.size);
+				} else {
+					s.ptr = instance.allocate(op.size);
+					if (!s.ptr)
+						abort();
+					live_bytes::allocated(op.size);
+				}
+
+				// Reset the slot for the next iteration after the last op.
+				s.seq.store(op.last ? 0 : op.seq + 1, std::memory_order_release);
+				if (num_threads > 1)
+					s.seq.notify_all();
+			}
+
+			done_barrier.arrive_and_wait();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t i = 0; i < num_threads; i++)
+		threads.emplace_back(thread_main, i);
+
+	auto iteration = [&] {
+		// Signal workers to start.
+		iter_barrier.arrive_and_wait();
+		// Wait for workers to finish this iteration.
+		done_barrier.arrive_and_wait();
+	};
+
+	// Warm up.
+	iteration();
+	// Timed benchmark.
+	for (auto _ : state)
+		iteration();
+
+	// Signal workers to terminate.
+	running.store(false, std::memory_order_relaxed);
+	iter_barrier.arrive_and_wait();
+
+	for (auto &t : threads)
+		t.join();
+
+	memory.finish(state);
+	state.counters["threads"] = num_threads;
+	state.SetItemsProcessed(state.iterations() * trace->num_ops);
+}
+
+// Replays are only registered if FRIGG_REPLAY_TRACE names a trace file.
+static bool register_replay_benchmarks() {
+	const char *path = getenv("FRIGG_REPLAY_TRACE");
+	if (!path)
+		return false;
+
+	static replay_trace trace;
+	if (auto error = trace.load(path)) {
+		fprintf(stderr, "%s: %s\n", path, error);
+		return false;
+	}
+
+	auto add = [] (const char *name, auto fn) {
+		benchmark::RegisterBenchmark(name, fn, &trace)
+		    ->Unit(benchmark::kMillisecond)
+		    ->UseRealTime();
+	};
+	add("BM_Allocators_Replay<slab_instance>", BM_Allocators_Replay<slab_instance>);
+	add("BM_Allocators_Replay<sharded_slab_instance>", BM_Allocators_Replay<sharded_slab_instance>);
+	add("BM_Allocators_Replay<system_instance>", BM_Allocators_Replay<system_instance>);
+	add("BM_Allocators_Replay<mimalloc_instance>", BM_Allocators_Replay<mimalloc_instance>);
+	return true;
+}
+
+[[maybe_unused]] static bool replay_registered = register_replay_benchmarks();
+
+BENCHMARK(BM_Allocators_SizeClasses<slab_instance>)->Arg(0)->Arg(1);
+BENCHMARK(BM_Allocators_SizeClasses<sharded_slab_instance>)->Arg(0)->Arg(1);
+BENCHMARK(BM_Allocators_SizeClasses<fine_sharded_slab_instance>)->Arg(0)->Arg(1);
+BENCHMARK(BM_Allocators_SizeClasses<guarded_sharded_slab_instance>)->Arg(0)->Arg(1);
+BENCHMARK(BM_Allocators_SizeClasses<system_instance>)->Arg(0)->Arg(1);
+BENCHMARK(BM_Allocators_SizeClasses<mimalloc_instance>)->Arg(0)->Arg(1);
+
+BENCHMARK(BM_Allocators_ObjectCache)->Arg(0)->Arg(1);
+
+BENCHMARK(BM_Allocators_LargeBuffers<slab_instance>);
+BENCHMARK(BM_Allocators_LargeBuffers<sharded_slab_instance>);
+BENCHMARK(BM_Allocators_LargeBuffers<arena_sharded_slab_instance>);
+BENCHMARK(BM_Allocators_LargeBuffers<system_instance>);
+BENCHMARK(BM_Allocators_LargeBuffers<mimalloc_instance>);
+
+BENCHMARK(BM_Allocators_MsgPass<slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPass<lock_free_slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPass<sharded_slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPass<system_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPass<mimalloc_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPassBatched<slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPassBatched<sharded_slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPassBatched<system_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_MsgPassBatched<mimalloc_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_ContendedBucket<slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_ContendedBucket<lock_free_slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_ContendedBucket<sharded_slab_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_ContendedBucket<system_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+BENCHMARK(BM_Allocators_ContendedBucket<mimalloc_instance>)
+    ->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+    ->Unit(benchmark::kMillisecond)
+    ->MeasureProcessCPUTime();
+
+static void workload_args(benchmark::internal::Benchmark *b) {
+	b->Arg(1)->Arg(2)->Arg(4)->Arg(8)
+	    ->Unit(benchmark::kMillisecond)
+	    ->MeasureProcessCPUTime();
+}
+
+static void producer_consumer_args(benchmark::internal::Benchmark *b) {
+	b->Arg(2)->Arg(4)->Arg(8)
+	    ->Unit(benchmark::kMillisecond)
+	    ->MeasureProcessCPUTime();
+}
+
+BENCHMARK(BM_Allocators_Larson<slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_Larson<sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_Larson<arena_sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_Larson<system_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_Larson<mimalloc_instance>)->Apply(workload_args);
+
+BENCHMARK(BM_Allocators_ProducerConsumer<slab_instance>)->Apply(producer_consumer_args);
+BENCHMARK(BM_Allocators_ProducerConsumer<sharded_slab_instance>)->Apply(producer_consumer_args);
+BENCHMARK(BM_Allocators_ProducerConsumer<system_instance>)->Apply(producer_consumer_args);
+BENCHMARK(BM_Allocators_ProducerConsumer<mimalloc_instance>)->Apply(producer_consumer_args);
+
+BENCHMARK(BM_Allocators_WorkingSet<slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_WorkingSet<sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_WorkingSet<arena_sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_WorkingSet<system_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_WorkingSet<mimalloc_instance>)->Apply(workload_args);
+
+BENCHMARK(BM_Allocators_ReallocChains<slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_ReallocChains<sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_ReallocChains<arena_sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_ReallocChains<system_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_ReallocChains<mimalloc_instance>)->Apply(workload_args);
+
+BENCHMARK(BM_Allocators_MixedSizes<slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_MixedSizes<sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_MixedSizes<arena_sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_MixedSizes<guarded_sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_MixedSizes<system_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_MixedSizes<mimalloc_instance>)->Apply(workload_args);
+
+BENCHMARK(BM_Allocators_FirstAllocation<slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_FirstAllocation<sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_FirstAllocation<arena_sharded_slab_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_FirstAllocation<system_instance>)->Apply(workload_args);
+BENCHMARK(BM_Allocators_FirstAllocation<mimalloc_instance>)->Apply(workload_args);
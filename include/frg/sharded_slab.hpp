@@ -5,11 +5,15 @@
 #include <atomic>
 #include <concepts>
 #include <new>
+#include <type_traits>
 
 #include <frg/bitops.hpp>
 #include <frg/expected.hpp>
+#include <frg/list.hpp>
 #include <frg/macros.hpp>
+#include <frg/rbtree.hpp>
 #include <frg/slab.hpp>
+#include <frg/span.hpp>
 #include <frg/string_stub.hpp>
 
 namespace frg FRG_VISIBILITY {
@@ -21,11 +25,66 @@ enum class error {
 	allocation_failed,
 };
 
+// Policies with a map(size, alignment) function return mappings that are aligned to alignment.
+// This avoids over-allocating mappings to align chunks to chunk_boundary.
+template<typename P>
+concept has_aligned_map_support = requires(P policy, size_t size) {
+	{ policy.map(size, size) } -> std::same_as<void *>;
+};
+
+// Policies with a decommit() function make the pool carve chunks out of superblocks
+// (see pool::superblock_arena). decommit(p, size) releases the memory backing a range
+// of a superblock (for example, using madvise() with MADV_DONTNEED) but keeps the range mapped.
+// If the policy also has a commit() function, commit(p, size) is called before
+// a range of a superblock is handed out.
+template<typename P>
+concept has_decommit_support = requires(P policy, void *p, size_t size) {
+	policy.decommit(p, size);
+};
+
+template<typename P>
+concept has_commit_support = requires(P policy, void *p, size_t size) {
+	policy.commit(p, size);
+};
+
+// Policies with protect() and unprotect() functions support guarded sampling
+// (see pool::guarded_sample_interval). protect(p, size) makes a page-aligned range
+// inaccessible (for example, using mprotect() with PROT_NONE) and unprotect(p, size)
+// makes it readable and writable again.
+template<typename P>
+concept has_guard_support = requires(P policy, void *p, size_t size) {
+	policy.protect(p, size);
+	policy.unprotect(p, size);
+};
+
+// Kinds of memory errors that are detected by guarded sampling.
+enum class guarded_error {
+	none,
+	use_after_free,
+	buffer_overflow,
+	buffer_underflow,
+};
+
+// Describes an access to a guarded page, see pool::explain_guarded_fault().
+struct guarded_report {
+	static constexpr size_t max_trace_depth = 16;
+
+	guarded_error error{guarded_error::none};
+	// The object that is closest to the faulting address.
+	void *object{nullptr};
+	size_t size{0};
+	// Stack traces of the object's allocation and (for use-after-free) its deallocation.
+	// These are only recorded if the policy implements walk_stack().
+	uintptr_t allocation_trace[max_trace_depth]{};
+	size_t allocation_depth{0};
+	uintptr_t deallocation_trace[max_trace_depth]{};
+	size_t deallocation_depth{0};
+};
+
 // TODO: We probably want to support customization features of frg::slab_pool in the future,
 //       in particular:
 //       * Slab size and page size overrides
 //       * Bucket customizations
-//       * Aligned page mapping functions
 template<typename P>
 concept Policy = requires(P policy, void *p, size_t size) {
 	// The map() and unmap() functions can be used to allocate and free memory at page granularity.
@@ -33,6 +92,9 @@ concept Policy = requires(P policy, void *p, size_t size) {
 	{ policy.unmap(p, size) } -> std::same_as<void>;
 };
 
+template<typename T, Policy P, size_t MaxCached>
+struct object_cache;
+
 // Thread-aware slab allocator.
 // The pool struct itself is not thread-safe; however, objects allocated
 // from one pool instance can be freed by another pool instance
@@ -48,11 +110,150 @@ struct pool {
 	// TODO: We may want to make this dependent on the number of objects in the chunk.
 	static constexpr size_t reactivate_threshold = 8;
 
+	// Number of fully free chunks that each bucket keeps indefinitely.
+	static constexpr size_t retained_empty_chunks = [] {
+		if constexpr (requires { P::retained_empty_chunks; }) {
+			return P::retained_empty_chunks;
+		} else {
+			return 1;
+		}
+	}();
+
+	// Upper bound on the number of fully free chunks per bucket.
+	// Chunks beyond this bound are released immediately, regardless of their age.
+	static constexpr size_t max_empty_chunks = [] {
+		if constexpr (requires { P::max_empty_chunks; }) {
+			return P::max_empty_chunks;
+		} else {
+			return 8;
+		}
+	}();
+
+	// Fully free chunks in excess of retained_empty_chunks are released once they
+	// stayed free for this many allocations or deallocations on the pool.
+	// This avoids map/unmap churn if the number of objects oscillates.
+	static constexpr uint64_t empty_chunk_decay = [] {
+		if constexpr (requires { P::empty_chunk_decay; }) {
+			return P::empty_chunk_decay;
+		} else {
+			return 4096;
+		}
+	}();
+
+	static_assert(retained_empty_chunks <= max_empty_chunks);
+
+	// Number of chunks for which the pool buffers remote frees.
+	// Buffered objects are returned to their chunk by a single CAS per chunk.
+	static constexpr size_t remote_free_groups = [] {
+		if constexpr (requires { P::remote_free_groups; }) {
+			return P::remote_free_groups;
+		} else {
+			return 8;
+		}
+	}();
+
+	// Maximal number of remote frees that are buffered per chunk.
+	static constexpr size_t remote_free_batch = [] {
+		if constexpr (requires { P::remote_free_batch; }) {
+			return P::remote_free_batch;
+		} else {
+			return 32;
+		}
+	}();
+
+	// Buffered remote frees are returned to their chunks at the latest once the pool
+	// performed this many allocations and frees after the oldest buffered free.
+	static constexpr uint64_t remote_free_max_age = [] {
+		if constexpr (requires { P::remote_free_max_age; }) {
+			return P::remote_free_max_age;
+		} else {
+			return 1024;
+		}
+	}();
+
+	// Upper bound on the size of the extents of freed large objects that are cached for reuse.
+	static constexpr size_t large_cache_bytes = [] {
+		if constexpr (requires { P::large_cache_bytes; }) {
+			return P::large_cache_bytes;
+		} else {
+			return size_t{1} << 22;
+		}
+	}();
+
+	// Cached extents are released once they were not reused for this many
+	// large allocations or frees.
+	static constexpr uint64_t large_cache_decay = [] {
+		if constexpr (requires { P::large_cache_decay; }) {
+			return P::large_cache_decay;
+		} else {
+			return 256;
+		}
+	}();
+
+	// Statistics are only maintained if the policy asks for them, see snapshot().
+	static constexpr bool enable_stats = [] {
+		if constexpr (requires { P::enable_stats; }) {
+			return P::enable_stats;
+		} else {
+			return false;
+		}
+	}();
+
+	// Chunks are taken from superblocks if the policy supports decommitting memory.
+	static constexpr bool enable_arena = has_decommit_support<P>;
+
+	// Size of the superblocks of the arena.
+	static constexpr size_t superblock_size = [] {
+		if constexpr (requires { P::superblock_size; }) {
+			return P::superblock_size;
+		} else {
+			return size_t{1} << 25;
+		}
+	}();
+
+	// Superblocks are aligned such that the policy can back them by 2 MiB huge pages.
+	static constexpr size_t superblock_alignment = size_t{1} << 21;
+
+	// Extents of large objects are taken from the arena up to this size.
+	// Larger extents are mapped individually.
+	static constexpr size_t max_arena_extent = superblock_size / 8;
+
+	// If non-zero, about one in guarded_sample_interval allocations of at most a page
+	// is placed on its own page between two guard pages, either at the end of the page
+	// (to catch overflows) or at its start (to catch underflows). Freed pages stay
+	// inaccessible until their slot is reused. Requires has_guard_support<P>.
+	// This is cheap enough to stay enabled in production, see guarded_allocate().
+	static constexpr size_t guarded_sample_interval = [] {
+		if constexpr (requires { P::guarded_sample_interval; }) {
+			return P::guarded_sample_interval;
+		} else {
+			return 0;
+		}
+	}();
+
+	static constexpr bool enable_guarded = guarded_sample_interval > 0;
+
+	static_assert(!enable_guarded || has_guard_support<P>,
+			"Guarded sampling requires protect() and unprotect()");
+
+	// Whether extents of large objects are usually aligned to chunk_boundary (i.e., without
+	// over-allocating). If so, only aligned extents are cached, see large_free().
+	static constexpr bool aligned_large_extents = enable_arena || has_aligned_map_support<P>;
+
+	static_assert(remote_free_groups > 0);
+	static_assert(remote_free_batch > 0);
+	static_assert(!(superblock_size & (chunk_boundary - 1)));
+	static_assert(superblock_size >= 8 * chunk_boundary);
+
 	// Stores the address of an object as the object's offset vs. its chunk_header.
 	// This is needed to be able to compress the chunk_state struct below to a size that can be manipulated by a single CAS.
 	// Note that zero is an invalid compressed_address (since the chunk_header is at offset zero).
 	using compressed_address = uint32_t;
 
+	// Number of bits of a compressed_address that are stored in chunk_state.
+	static constexpr int compressed_address_bits = 20;
+	static_assert(chunk_size <= (size_t{1} << compressed_address_bits));
+
 	// State for chunks.
 	// Chunks can be in several states:
 	// - Chunks are said to be INACTIVE if chunk_state::inactive is set.
@@ -61,54 +262,62 @@ struct pool {
 	//   * and the chunk is in bucket::owner_pending_list or bucket::threaded_pending_list.
 	// - Chunks are said to be ACTIVE if:
 	//   * chunk_state::inactive is clear
-	//   * and the chunk is in bucket::active_list or bucket::head_chunk.
+	//   * and the chunk is in bucket::active_tree or bucket::head_chunk.
+	// - Chunks are said to be EMPTY if:
+	//   * chunk_state::inactive is clear
+	//   * and the chunk is in bucket::empty_list.
+	//   EMPTY chunks have no live objects, i.e., all objects are either on owner_free
+	//   or were never carved off (see chunk_header::carve).
 	//
 	// State transitions follow the following invariants:
 	// - Any pool instance (i.e., every thread) can transition a chunk from INACTIVE to PENDING.
 	//   This is done by first clearing chunk_state::inactive followed by pushing the chunk onto
-	//   bucket::owner_pending_list or bucket::threaded_pending_list.
+	//   bucket::threaded_pending_list. If the owner clears chunk_state::inactive, it
+	//   makes the chunk ACTIVE or EMPTY immediately.
 	//   Note that no locking is done during this transition;
 	//   hence, it is possible for chunks with inactive clear to not be in any list.
+	// - While a chunk is INACTIVE, its owner_count is zero and all frees (including those of
+	//   the owner) go to threaded_free. Thus, the thread whose free makes threaded_count reach
+	//   reactivate_count() transitions the chunk to PENDING; in particular, this happens
+	//   before the chunk can become fully free.
 	// - No other transition is allowed from INACTIVE state.
 	// - Only the owner can transition chunks from PENDING or ACTIVE state into other states.
-	//   As a result, only the owner can transition a chunk to INACTIVE.
+	//   As a result, only the owner can transition a chunk to INACTIVE or EMPTY.
+	// - Only EMPTY chunks are released back to the policy.
+	//
+	// When a pool is destroyed, it releases all of its chunks that are fully free and
+	// transitions all other chunks to ORPHANED. ORPHANED chunks have no owner,
+	// chunk_state::orphaned is set and chunk_state::inactive is clear.
+	// ORPHANED chunks are on the orphan list of their bucket (bucket::orphans)
+	// until another pool adopts them. Other threads can only push onto threaded_free
+	// of ORPHANED chunks.
 	struct alignas(sizeof(uint64_t)) chunk_state {
 		// Head of the threaded free list.
-		compressed_address threaded_free;
+		uint64_t threaded_free : compressed_address_bits;
+		// Tail of the threaded free list (only valid if threaded_free is non-zero).
+		// This allows the owner to splice the list in O(1).
+		uint64_t threaded_tail : compressed_address_bits;
 		// Size of the threaded free list.
-		uint32_t threaded_count : 31;
+		uint64_t threaded_count : 22;
+		// True if chunk is ORPHANED.
+		bool orphaned : 1;
 		// True if chunk is INACTIVE (not on any list).
 		bool inactive : 1;
 	};
+	static_assert(sizeof(chunk_state) == sizeof(uint64_t));
 	static_assert(sizeof(chunk_state) == 8);
 	static_assert(alignof(chunk_state) == 8);
 	static_assert(std::atomic<chunk_state>::is_always_lock_free);
 
 	// Limit on the number of objects due to number of bits of threaded_count.
-	static constexpr size_t max_objects_in_chunk = (size_t{1} << 31) - 1;
+	static constexpr size_t max_objects_in_chunk = (size_t{1} << 22) - 1;
 
 	// Free list of objects.
 	struct free_object {
 		compressed_address next{0};
 	};
 
-	struct chunk_header;
-
-	// Each bucket manages allocations for a specific size class.
-	struct bucket {
-		// Size of the objects stored in the slab.
-		size_t object_size{0};
-		// Current chunk we allocate from. If null, pop from active_list.
-		chunk_header *head_chunk{nullptr};
-		// List of other ACTIVE chunks (with non-empty owner_free).
-		// TODO: It may make sense to use a rbtree tree here to get first-fit behavior.
-		//       This should reduce fragmentation and we only need to look at this
-		//       data structure if there is no head_chunk anyway.
-		chunk_header *active_list{nullptr};
-		// Lists of PENDING chunks.
-		chunk_header *owner_pending_list{nullptr};
-		std::atomic<chunk_header *> threaded_pending_list{nullptr};
-	};
+	struct bucket;
 
 	enum class chunk_type {
 		none,
@@ -116,6 +325,19 @@ struct pool {
 		slab,
 		// Chunks that consist of only a single object.
 		large,
+		// The chunk of guarded_region.
+		guarded,
+	};
+
+	// Owner-side bookkeeping of the list that a chunk is in.
+	// This is only accessed by the owner. In particular, chunks in
+	// bucket::threaded_pending_list have chunk_location::none.
+	enum class chunk_location {
+		none,
+		head,
+		active,
+		owner_pending,
+		empty,
 	};
 
 	// A chunk is a contiguous memory range that consists of a header
@@ -124,15 +346,35 @@ struct pool {
 	// The header is followed by memory objects such that the total size of the chunk is chunk_size.
 	struct chunk_header {
 		chunk_type type{chunk_type::none};
-		pool *owner{nullptr};
+		// Pool that owns the chunk. Other threads only compare this against their own pool.
+		std::atomic<pool *> owner{nullptr};
+		// Bucket of the owner. Only valid while the chunk is not ORPHANED.
 		bucket *bkt{nullptr};
+		// Size of the objects stored in the chunk.
+		// Unlike bkt->object_size, this is also valid for ORPHANED chunks.
+		size_t object_size{0};
 		// Head of the free list that the owner uses for allocations.
 		compressed_address owner_free{0};
-		// Number of items on the owner_free list.
+		// Objects at or above this offset were never allocated and are not on any free list.
+		// They are carved off lazily once owner_free is exhausted.
+		compressed_address carve{0};
+		// Number of objects that the owner can allocate,
+		// i.e., items on the owner_free list plus objects that were not carved off yet.
 		uint32_t owner_count{0};
+		// Total number of objects in the chunk.
+		uint32_t object_count{0};
 		std::atomic<chunk_state> state{};
-		// Next chunk in either bucket::active_list, bucket::owner_pending_list and bucket::threaded_pending_list.
+		// Next chunk in bucket::threaded_pending_list.
 		chunk_header *next_in_list{nullptr};
+		// Hook for bucket::owner_pending_list and bucket::empty_list.
+		frg::default_list_hook<chunk_header> list_hook{};
+		// Hook for bucket::active_tree.
+		frg::rbtree_hook active_hook{};
+		// Hook for bucket::chunks.
+		frg::default_list_hook<chunk_header> bucket_hook{};
+		chunk_location location{chunk_location::none};
+		// Value of pool::clock_ when the chunk became EMPTY.
+		uint64_t empty_since{0};
 		// Pointer to the chunk's extent.
 		// This is the chunk's memory range including padding that is in front of chunk_header.
 		void *extent_ptr{nullptr};
@@ -140,21 +382,111 @@ struct pool {
 		size_t extent_size{0};
 	};
 
+	using chunk_list = frg::intrusive_list<
+		chunk_header,
+		frg::locate_member<
+			chunk_header,
+			frg::default_list_hook<chunk_header>,
+			&chunk_header::list_hook
+		>
+	>;
+
+	struct chunk_less {
+		bool operator() (const chunk_header &a, const chunk_header &b) {
+			return &a < &b;
+		}
+	};
+
+	using chunk_tree = frg::rbtree<
+		chunk_header,
+		&chunk_header::active_hook,
+		chunk_less
+	>;
+
+	using bucket_chunk_list = frg::intrusive_list<
+		chunk_header,
+		frg::locate_member<
+			chunk_header,
+			frg::default_list_hook<chunk_header>,
+			&chunk_header::bucket_hook
+		>
+	>;
+
+	// Remote frees to a single chunk that are not yet pushed onto threaded_free.
+	struct remote_group {
+		chunk_header *chunk;
+		compressed_address head;
+		compressed_address tail;
+		uint32_t count;
+	};
+
+	// Each bucket manages allocations for a specific size class.
+	struct bucket {
+		// Size of the objects stored in the slab.
+		size_t object_size{0};
+		// Current chunk we allocate from. If null, take the lowest chunk from active_tree.
+		chunk_header *head_chunk{nullptr};
+		// Other ACTIVE chunks (with non-zero owner_count), ordered by address.
+		// Like slab_pool's partial_tree, refilling head_chunk from the lowest address
+		// concentrates live objects in few chunks, such that the others can become EMPTY.
+		chunk_tree active_tree;
+		// Lists of PENDING chunks.
+		chunk_list owner_pending_list;
+		std::atomic<chunk_header *> threaded_pending_list{nullptr};
+		// List of EMPTY chunks. The most recently emptied chunk is at the front.
+		chunk_list empty_list;
+		// Number of chunks in empty_list.
+		size_t num_empty{0};
+		// All slab chunks that are owned by this bucket, regardless of their state.
+		bucket_chunk_list chunks;
+		// List of ORPHANED chunks that this bucket adopts. This is shared by all
+		// buckets of the same size class (or of the same object_cache type) across pools.
+		std::atomic<chunk_header *> *orphans{nullptr};
+		// Index into the per-bucket statistics. Buckets of an object_cache are
+		// accounted to the size class that contains their object_size.
+		size_t stats_index{0};
+	};
+
 	constexpr pool() {
 		for (size_t i = 0; i < policy_traits::num_buckets; i++) {
 			buckets_[i].object_size = policy_traits::bucket_to_size(i);
+			buckets_[i].orphans = &orphan_lists_[i];
+			buckets_[i].stats_index = i;
 		}
 	}
 
+	pool(const pool &) = delete;
+
+	pool &operator= (const pool &) = delete;
+
+	// Releases all chunks that are fully free and orphans all other chunks,
+	// such that they can be adopted by other pools.
+	~pool() {
+		flush();
+		for (size_t i = 0; i < policy_traits::num_buckets; i++)
+			slab_bucket_teardown(&buckets_[i]);
+		large_cache_.clear([&] (uintptr_t base, size_t size) {
+			large_unmap(base, size);
+		});
+	}
+
 	void *allocate(size_t size) {
 		void *obj;
 		if (size > policy_traits::max_bucket_size) {
-			auto result = large_allocate(size);
+			auto result = large_allocate(size, page_size);
 			if (!result)
 				return nullptr;
 			obj = result.value();
 		} else {
 			auto idx = policy_traits::size_to_bucket(size);
+			if constexpr (enable_guarded) {
+				if (!--guarded_countdown_) [[unlikely]] {
+					if (auto guarded = guarded_allocate(&buckets_[idx], size)) {
+						slab::trace(policy_, 'a', guarded, size);
+						return guarded;
+					}
+				}
+			}
 			auto result = slab_allocate(&buckets_[idx], size);
 			if (!result)
 				return nullptr;
@@ -164,6 +496,67 @@ struct pool {
 		return obj;
 	}
 
+	// Allocate objects.size() objects of the given size.
+	// Returns the number of objects that were allocated; this is only less
+	// than objects.size() if the policy fails to map memory.
+	size_t allocate_bulk(size_t size, frg::span<void *> objects) {
+		if (size > policy_traits::max_bucket_size) {
+			size_t n = 0;
+			while (n < objects.size()) {
+				auto result = large_allocate(size, page_size);
+				if (!result)
+					break;
+				objects[n] = result.value();
+				slab::trace(policy_, 'a', objects[n], size);
+				n++;
+			}
+			return n;
+		}
+
+		auto bkt = &buckets_[policy_traits::size_to_bucket(size)];
+		auto n = slab_allocate_bulk(bkt, size, objects);
+		for (size_t i = 0; i < n; i++)
+			slab::trace(policy_, 'a', objects[i], size);
+		return n;
+	}
+
+	// Allocate memory that is aligned to alignment, which must be a power of two.
+	// Alignments up to chunk_boundary / 2 are supported.
+	// The returned pointer can be passed to deallocate(), reallocate() and get_size().
+	void *allocate_aligned(size_t size, size_t alignment) {
+		FRG_ASSERT(is_p2(alignment));
+
+		// Chunks are aligned to chunk_boundary and objects are placed at multiples of their
+		// bucket's object_size, relative to the chunk_header. Hence, objects are aligned to
+		// the largest power of two that divides object_size. Find the smallest such bucket.
+		if (alignment < page_size) {
+			size_t min_size = size < alignment ? alignment : size;
+			if (min_size <= policy_traits::max_bucket_size) {
+				size_t idx = policy_traits::size_to_bucket(min_size);
+				while (idx < policy_traits::num_buckets && (buckets_[idx].object_size & (alignment - 1)))
+					idx++;
+				if (idx < policy_traits::num_buckets) {
+					auto result = slab_allocate(&buckets_[idx], size);
+					if (!result)
+						return nullptr;
+					slab::trace(policy_, 'a', result.value(), size);
+					return result.value();
+				}
+			}
+		}
+
+		// Page-aligned and larger requests go through the large path.
+		// The object must not start at a chunk_boundary, otherwise chunk_header_of() fails.
+		if (alignment > chunk_boundary / 2)
+			return nullptr;
+		auto result = large_allocate(size, alignment < page_size ? page_size : alignment);
+		if (!result)
+			return nullptr;
+		FRG_ASSERT(!(reinterpret_cast<uintptr_t>(result.value()) & (alignment - 1)));
+		slab::trace(policy_, 'a', result.value(), size);
+		return result.value();
+	}
+
 	void *reallocate(void *object, size_t new_size) {
 		if (!object)
 			return allocate(new_size);
@@ -173,14 +566,37 @@ struct pool {
 		}
 
 		auto chunk = chunk_header_of(object);
+		if constexpr (enable_guarded) {
+			// Always move guarded objects, such that they stay adjacent to a guard page.
+			if (chunk->type == chunk_type::guarded) {
+				size_t capacity = guarded_capacity(object);
+				auto new_object = allocate(new_size);
+				if (!new_object)
+					return nullptr;
+				memcpy(new_object, object, capacity < new_size ? capacity : new_size);
+				deallocate(object);
+				return new_object;
+			}
+		}
+
 		size_t capacity;
 		if (chunk->type == chunk_type::slab) {
-			capacity = chunk->bkt->object_size;
+			capacity = chunk->object_size;
 		} else {
 			FRG_ASSERT(chunk->type == chunk_type::large);
 			uintptr_t limit = reinterpret_cast<uintptr_t>(chunk->extent_ptr) + chunk->extent_size;
 			uintptr_t start = reinterpret_cast<uintptr_t>(object);
 			capacity = limit - start;
+
+			if constexpr (slab::has_remap_support<P, void *>) {
+				if (auto new_object = large_remap(chunk, object, new_size)) {
+					if (new_object != object) {
+						slab::trace(policy_, 'f', object, 0);
+						slab::trace(policy_, 'a', new_object, new_size);
+					}
+					return new_object;
+				}
+			}
 		}
 
 		if (new_size <= capacity) {
@@ -208,19 +624,67 @@ struct pool {
 			large_free(chunk);
 			return;
 		}
-		if (chunk->owner == this) {
+		if constexpr (enable_guarded) {
+			if (chunk->type == chunk_type::guarded) {
+				guarded_free(object);
+				return;
+			}
+		}
+		if (chunk->owner.load(std::memory_order_relaxed) == this) {
 			slab_deallocate_owned(chunk, object);
 		} else {
 			slab_deallocate_threaded(chunk, object);
 		}
 	}
 
+	// Deallocate all objects in the span. Null pointers are ignored.
+	// Remote frees to the same chunk are batched by the remote free buffer.
+	void deallocate_bulk(frg::span<void *> objects) {
+		for (auto object : objects)
+			deallocate(object);
+	}
+
+	// Return all buffered remote frees to their chunks.
+	// Remote frees are buffered per pool, such that each chunk costs a single CAS per batch.
+	// Buffered frees are flushed after remote_free_max_age allocations and frees
+	// of this pool and when the pool is destroyed. Pools that stop allocating and freeing
+	// (e.g., because their thread goes idle) should call this function.
+	void flush() {
+		for (size_t k = 0; k < num_remote_groups_; k++)
+			slab_remote_group_flush(remote_groups_[k]);
+		num_remote_groups_ = 0;
+		next_remote_eviction_ = 0;
+		remote_flush_deadline_ = ~uint64_t{0};
+	}
+
+	slab::extent_cache_stats large_cache_stats() {
+		return large_cache_.stats();
+	}
+
+	using stats_type = slab::pool_stats<policy_traits::num_buckets>;
+
+	// Returns the current statistics of this pool. Only available if enable_stats is true.
+	// Unlike the other functions, this can be called concurrently to allocations from this pool.
+	// Remote frees are accounted to the pool that frees the object,
+	// hence the snapshots of all pools need to be summed up to obtain global values.
+	stats_type snapshot() const requires (enable_stats) {
+		stats_type stats;
+		for (size_t i = 0; i < policy_traits::num_buckets; i++)
+			stats.buckets[i].object_size = buckets_[i].object_size;
+		stats_.snapshot(stats);
+		return stats;
+	}
+
 	size_t get_size(void *object) {
 		if (!object)
 			return 0;
 		auto chunk = chunk_header_of(object);
+		if constexpr (enable_guarded) {
+			if (chunk->type == chunk_type::guarded)
+				return guarded_capacity(object);
+		}
 		if (chunk->type == chunk_type::slab) {
-			return chunk->bkt->object_size;
+			return chunk->object_size;
 		} else {
 			FRG_ASSERT(chunk->type == chunk_type::large);
 			uintptr_t limit = reinterpret_cast<uintptr_t>(chunk->extent_ptr) + chunk->extent_size;
@@ -229,7 +693,66 @@ struct pool {
 		}
 	}
 
+	// Explains a fault at the given address (e.g., from a page fault handler).
+	// Returns false if the address does not belong to a guarded page.
+	static bool explain_guarded_fault(const void *address, guarded_report &report)
+	requires (enable_guarded) {
+		auto &g = guarded_;
+		auto addr = reinterpret_cast<uintptr_t>(address);
+		unique_lock<simple_spinlock> guard(g.mutex);
+		auto base = reinterpret_cast<uintptr_t>(g.chunk);
+		if (!base || addr < base + page_size || addr >= base + chunk_size)
+			return false;
+
+		// Data pages are at even and guard pages at odd page indices (page 0 is the header).
+		// For guard pages, blame the closest object in the slots before and after it.
+		size_t page = (addr - base) / page_size;
+		guarded_slot *slot = nullptr;
+		auto distance = [&] (guarded_slot *candidate) -> uintptr_t {
+			auto object = reinterpret_cast<uintptr_t>(candidate->object);
+			if (!object)
+				return ~uintptr_t{0};
+			if (addr < object)
+				return object - addr;
+			return addr - (object + candidate->size);
+		};
+		if (!(page % 2)) {
+			slot = &g.slots[page / 2 - 1];
+		} else {
+			auto before = page >= 3 ? &g.slots[page / 2 - 1] : nullptr;
+			auto after = page / 2 < guarded_region::num_slots ? &g.slots[page / 2] : nullptr;
+			slot = before;
+			if (!before || (after && distance(after) < distance(before)))
+				slot = after;
+		}
+		if (!slot || !slot->object)
+			return false;
+
+		auto object = reinterpret_cast<uintptr_t>(slot->object);
+		if (!slot->allocated) {
+			report.error = guarded_error::use_after_free;
+		} else if (addr >= object + slot->size) {
+			report.error = guarded_error::buffer_overflow;
+		} else if (addr < object) {
+			report.error = guarded_error::buffer_underflow;
+		} else {
+			report.error = guarded_error::none;
+		}
+		report.object = slot->object;
+		report.size = slot->size;
+		report.allocation_depth = slot->allocation_trace.depth;
+		memcpy(report.allocation_trace, slot->allocation_trace.frames,
+				sizeof(report.allocation_trace));
+		report.deallocation_depth = slot->deallocation_trace.depth;
+		memcpy(report.deallocation_trace, slot->deallocation_trace.frames,
+				sizeof(report.deallocation_trace));
+		return true;
+	}
+
 private:
+	template<typename T, Policy Q, size_t MaxCached>
+	friend struct object_cache;
+
 	// Find the chunk_header for an object by aligning the pointer down to chunk_boundary.
 	chunk_header *chunk_header_of(void *object) {
 		auto addr = reinterpret_cast<uintptr_t>(object);
@@ -247,18 +770,199 @@ private:
 		return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(chunk) + ca);
 	}
 
+	// Offset of the first object in a chunk vs. its chunk_header.
+	// Objects are placed at multiples of object_size (which is not necessarily a power of two),
+	// hence they are aligned to the largest power of two that divides object_size.
+	static size_t first_object_offset(size_t object_size) {
+		return (sizeof(chunk_header) + object_size - 1) / object_size * object_size;
+	}
+
+	size_t bucket_index(bucket *bkt) {
+		return bkt->stats_index;
+	}
+
+	// Calls f with the statistics counters if statistics are enabled.
+	template<typename F>
+	void count_stats(F f) {
+		if constexpr (enable_stats)
+			f(stats_);
+	}
+
+	// Number of free objects that are required to transition an INACTIVE chunk to PENDING.
+	static size_t reactivate_count(chunk_header *chunk) {
+		if (chunk->object_count < reactivate_threshold)
+			return chunk->object_count;
+		return reactivate_threshold;
+	}
+
+	// A mapping that contains a range that is aligned to the requested alignment.
+	struct aligned_mapping {
+		void *ptr;
+		size_t size;
+		uintptr_t aligned_addr;
+	};
+
+	// Map at least size bytes (a multiple of page_size) starting at a multiple of alignment.
+	// If the policy does not support aligned mappings, over-allocate and align up.
+	static aligned_mapping map_aligned(P &policy, size_t size, size_t alignment) {
+		if constexpr (has_aligned_map_support<P>) {
+			auto ptr = policy.map(size, alignment);
+			return {ptr, size, reinterpret_cast<uintptr_t>(ptr)};
+		} else {
+			auto extent_size = (size + alignment - 1 + page_size - 1) & ~(page_size - 1);
+			auto ptr = policy.map(extent_size);
+			auto aligned_addr = (reinterpret_cast<uintptr_t>(ptr) + alignment - 1) & ~(alignment - 1);
+			return {ptr, extent_size, aligned_addr};
+		}
+	}
+
+	// Reserves address space in superblocks and hands out extents that consist of
+	// whole chunk_boundary-sized slots. Compared to mapping each chunk individually,
+	// this avoids over-allocating to align chunks and keeps the number of mappings low.
+	// Free slots are decommitted; superblocks are unmapped once all of their slots are free.
+	// Shared by all pools with the same policy since chunks can be released by any pool.
+	struct superblock_arena {
+		static constexpr size_t num_slots = superblock_size / chunk_boundary;
+
+		// Stored in the first slot of each superblock.
+		struct superblock {
+			// Returns the first slot of a run of n free slots or zero if there is none.
+			// Slot zero is always in use since it holds the superblock itself.
+			size_t find_slots(size_t n) {
+				size_t run = 0;
+				for (size_t s = 1; s < num_slots; ++s) {
+					if (used[s / 64] & (uint64_t{1} << (s % 64))) {
+						run = 0;
+					} else if (++run == n) {
+						return s + 1 - n;
+					}
+				}
+				return 0;
+			}
+
+			void mark_slots(size_t first, size_t n, bool in_use) {
+				for (size_t s = first; s < first + n; ++s) {
+					if (in_use) {
+						used[s / 64] |= uint64_t{1} << (s % 64);
+					} else {
+						used[s / 64] &= ~(uint64_t{1} << (s % 64));
+					}
+				}
+				if (in_use) {
+					used_slots += n;
+				} else {
+					used_slots -= n;
+				}
+			}
+
+			uintptr_t base() {
+				return reinterpret_cast<uintptr_t>(this);
+			}
+
+			superblock *next;
+			void *mapping_ptr;
+			size_t mapping_size;
+			// Number of slots in use (including slot zero).
+			size_t used_slots;
+			uint64_t used[(num_slots + 63) / 64];
+		};
+
+		// Returns a chunk_boundary-aligned extent of size bytes (a multiple of chunk_boundary)
+		// or nullptr if no superblock could be mapped.
+		void *take(P &policy, size_t size) {
+			size_t n = size / chunk_boundary;
+			FRG_ASSERT(n && n < num_slots);
+
+			void *ptr = nullptr;
+			{
+				unique_lock<simple_spinlock> guard(mutex_);
+				for (auto sb = superblocks_; sb; sb = sb->next) {
+					if (auto first = sb->find_slots(n); first) {
+						sb->mark_slots(first, n, true);
+						ptr = reinterpret_cast<void *>(sb->base() + first * chunk_boundary);
+						break;
+					}
+				}
+			}
+
+			// Map a new superblock without holding the lock.
+			if (!ptr) {
+				auto mapping = map_aligned(policy, superblock_size, superblock_alignment);
+				if (!mapping.ptr)
+					return nullptr;
+				auto sb = new (reinterpret_cast<void *>(mapping.aligned_addr)) superblock{
+					.next{nullptr},
+					.mapping_ptr{mapping.ptr},
+					.mapping_size{mapping.size},
+					.used_slots{0},
+					.used{},
+				};
+				sb->mark_slots(0, 1, true);
+				sb->mark_slots(1, n, true);
+				ptr = reinterpret_cast<void *>(sb->base() + chunk_boundary);
+
+				unique_lock<simple_spinlock> guard(mutex_);
+				sb->next = superblocks_;
+				superblocks_ = sb;
+			}
+
+			if constexpr (has_commit_support<P>)
+				policy.commit(ptr, size);
+			return ptr;
+		}
+
+		// Returns an extent that was obtained from take().
+		void put(P &policy, void *ptr, size_t size) {
+			auto addr = reinterpret_cast<uintptr_t>(ptr);
+			size_t n = size / chunk_boundary;
+
+			// The slots must be decommitted before they can be taken again.
+			policy.decommit(ptr, size);
+
+			superblock *released = nullptr;
+			{
+				unique_lock<simple_spinlock> guard(mutex_);
+				auto link = &superblocks_;
+				while (addr - (*link)->base() >= superblock_size) {
+					link = &(*link)->next;
+					FRG_ASSERT(*link);
+				}
+
+				auto sb = *link;
+				sb->mark_slots((addr - sb->base()) / chunk_boundary, n, false);
+				if (sb->used_slots == 1) {
+					*link = sb->next;
+					released = sb;
+				}
+			}
+
+			if (released)
+				policy.unmap(released->mapping_ptr, released->mapping_size);
+		}
+
+	private:
+		simple_spinlock mutex_;
+		superblock *superblocks_{nullptr};
+	};
+
 	frg::expected<error> slab_chunk_create(bucket *bkt) {
 		FRG_ASSERT(!bkt->head_chunk);
 
-		// Over-allocate to ensure we can align to chunk_boundary.
-		auto extent_size = (chunk_size + chunk_boundary - 1 + page_size - 1) & ~(page_size - 1);
-		auto extent_ptr = policy_.map(extent_size);
+		void *extent_ptr;
+		size_t extent_size;
+		uintptr_t aligned_addr;
+		if constexpr (enable_arena) {
+			extent_ptr = arena_.take(policy_, chunk_size);
+			extent_size = chunk_size;
+			aligned_addr = reinterpret_cast<uintptr_t>(extent_ptr);
+		} else {
+			auto mapping = map_aligned(policy_, chunk_size, chunk_boundary);
+			extent_ptr = mapping.ptr;
+			extent_size = mapping.size;
+			aligned_addr = mapping.aligned_addr;
+		}
 		if (!extent_ptr)
 			return error::allocation_failed;
-
-		// Align up to chunk_boundary.
-		auto raw_addr = reinterpret_cast<uintptr_t>(extent_ptr);
-		auto aligned_addr = (raw_addr + chunk_boundary - 1) & ~(chunk_boundary - 1);
 		auto chunk = reinterpret_cast<chunk_header *>(aligned_addr);
 
 		if constexpr (slab::has_poisoning_support<P>)
@@ -268,105 +972,209 @@ private:
 			.type{chunk_type::slab},
 			.owner{this},
 			.bkt{bkt},
+			.object_size{bkt->object_size},
 			.state{
 				chunk_state{
 					.threaded_free{0},
+					.threaded_tail{0},
 					.threaded_count{0},
+					.orphaned{false},
 					.inactive{false},
 				}
 			},
+			.location{chunk_location::head},
 			.extent_ptr{extent_ptr},
 			.extent_size{extent_size},
 		};
 
-		// Build free list of all objects in the chunk.
+		// Objects are carved off lazily by slab_chunk_pop(),
+		// such that we do not touch all pages of the chunk up front.
 		size_t object_size = bkt->object_size;
-		size_t first_offset = (sizeof(chunk_header) + object_size - 1) & ~(object_size - 1);
-
-		compressed_address prev = 0;
-		size_t count = 0;
-		for (size_t offset = first_offset; offset + object_size <= chunk_size; offset += object_size) {
-			auto obj = object_from_address(chunk, offset);
-			if constexpr (slab::has_poisoning_support<P>) {
-				policy_.unpoison(obj, sizeof(free_object));
-			}
-			auto free_obj = new (object_from_address(chunk, offset)) free_object{};
-			free_obj->next = prev;
-			prev = static_cast<compressed_address>(offset);
-			count++;
-		}
+		size_t first_offset = first_object_offset(object_size);
+		size_t count = (chunk_size - first_offset) / object_size;
 		FRG_ASSERT(count <= max_objects_in_chunk);
-		chunk->owner_free = prev;
+		chunk->carve = first_offset;
 		chunk->owner_count = count;
+		chunk->object_count = count;
 
+		bkt->chunks.push_back(chunk);
 		bkt->head_chunk = chunk;
+		count_stats([&] (auto &stats) { stats.buckets[bucket_index(bkt)].slabs_mapped.add(1); });
 		return {};
 	}
 
-	// Pop a single chunk from one of the pending lists and add it to active_list.
+	// Return a chunk's memory to the policy.
+	// The chunk must not be on any list except for bucket::chunks.
+	void slab_chunk_release(chunk_header *chunk) {
+		FRG_ASSERT(chunk->owner_count == chunk->object_count);
+		if (chunk->bucket_hook.in_list)
+			chunk->bkt->chunks.erase(chunk->bkt->chunks.iterator_to(chunk));
+		count_stats([&] (auto &stats) {
+			// Use object_size since chunk->bkt is not valid for ORPHANED chunks.
+			auto &c = stats.buckets[policy_traits::size_to_bucket(chunk->object_size)];
+			c.slabs_unmapped.add(1);
+			c.bytes_released.add(chunk->carve - first_object_offset(chunk->object_size));
+		});
+		auto *extent_ptr = chunk->extent_ptr;
+		size_t extent_size = chunk->extent_size;
+
+		if constexpr (slab::has_poisoning_support<P>) {
+			policy_.unpoison_expand(extent_ptr, extent_size);
+			policy_.poison(extent_ptr, extent_size);
+		}
+
+		if constexpr (enable_arena) {
+			arena_.put(policy_, extent_ptr, extent_size);
+		} else {
+			policy_.unmap(extent_ptr, extent_size);
+		}
+	}
+
+	// Append the list of objects in the threaded_free list of old_state to owner_free.
+	// The caller must have removed that list from the chunk_state.
+	void slab_chunk_splice(chunk_header *chunk, chunk_state old_state) {
+		if (!old_state.threaded_free)
+			return;
+
+		auto tail = static_cast<free_object *>(object_from_address(chunk, old_state.threaded_tail));
+		FRG_ASSERT(!tail->next);
+		tail->next = chunk->owner_free;
+		chunk->owner_free = old_state.threaded_free;
+		chunk->owner_count += old_state.threaded_count;
+	}
+
+	// Obtain threaded_free and append it to owner_free.
+	// This must only be called on chunks that are not INACTIVE.
+	void slab_chunk_merge(chunk_header *chunk) {
+		chunk_state current_state = chunk->state.exchange(
+			chunk_state{
+				.threaded_free{0},
+				.threaded_tail{0},
+				.threaded_count{0},
+				.orphaned{false},
+				.inactive{false},
+			},
+			std::memory_order_acquire
+		);
+		FRG_ASSERT(!current_state.inactive);
+		slab_chunk_splice(chunk, current_state);
+	}
+
+	// Transition a chunk that is not on any list to EMPTY.
+	void slab_chunk_make_empty(bucket *bkt, chunk_header *chunk) {
+		FRG_ASSERT(chunk->owner_count == chunk->object_count);
+		chunk->location = chunk_location::empty;
+		chunk->empty_since = clock_;
+		bkt->empty_list.push_front(chunk);
+		bkt->num_empty++;
+		slab_chunk_decay(bkt);
+	}
+
+	// Release EMPTY chunks that exceed the per-bucket reserve and that are either too old
+	// or that exceed max_empty_chunks. The oldest chunks are at the back of empty_list.
+	void slab_chunk_decay(bucket *bkt) {
+		while (bkt->num_empty > retained_empty_chunks) {
+			auto chunk = bkt->empty_list.back();
+			if (bkt->num_empty <= max_empty_chunks
+					&& clock_ - chunk->empty_since < empty_chunk_decay)
+				break;
+			bkt->empty_list.pop_back();
+			bkt->num_empty--;
+			chunk->location = chunk_location::none;
+			slab_chunk_release(chunk);
+		}
+	}
+
+	// Called by the owner if a chunk that is on one of the owner's lists may have become fully free.
+	void slab_chunk_check_empty(chunk_header *chunk) {
+		auto bkt = chunk->bkt;
+		switch (chunk->location) {
+		case chunk_location::head:
+			// We always keep the head_chunk, even if it is fully free.
+			return;
+		case chunk_location::active:
+			bkt->active_tree.remove(chunk);
+			break;
+		case chunk_location::owner_pending:
+			bkt->owner_pending_list.erase(bkt->owner_pending_list.iterator_to(chunk));
+			break;
+		default:
+			FRG_ASSERT(!"unexpected chunk_location for fully free chunk");
+		}
+
+		chunk->location = chunk_location::none;
+		slab_chunk_merge(chunk);
+		slab_chunk_make_empty(bkt, chunk);
+	}
+
+	// Pop a single chunk from one of the pending lists and add it to active_tree.
 	// This needs to be called regularly for maintenance of the data structure.
 	// We call it on each allocation.
 	void slab_chunk_update(bucket *bkt) {
 		// If owner_pending_list becomes empty, steal the entire threaded_pending_list.
-		if (!bkt->owner_pending_list) {
+		if (bkt->owner_pending_list.empty()) {
 			if (!bkt->threaded_pending_list.load(std::memory_order_relaxed))
 				return;
-			bkt->owner_pending_list = bkt->threaded_pending_list.exchange(nullptr, std::memory_order_acquire);
-			FRG_ASSERT(bkt->owner_pending_list);
+			chunk_header *stolen = bkt->threaded_pending_list.exchange(nullptr, std::memory_order_acquire);
+			FRG_ASSERT(stolen);
+			while (stolen) {
+				auto next = stolen->next_in_list;
+				stolen->next_in_list = nullptr;
+				FRG_ASSERT(stolen->location == chunk_location::none);
+				stolen->location = chunk_location::owner_pending;
+				bkt->owner_pending_list.push_back(stolen);
+				stolen = next;
+			}
 		}
 
 		// Pop from owner_pending_list.
-		chunk_header *chunk = bkt->owner_pending_list;
-		bkt->owner_pending_list = chunk->next_in_list;
+		chunk_header *chunk = bkt->owner_pending_list.pop_front();
 
-		// Add to active_list.
-		chunk->next_in_list = bkt->active_list;
-		bkt->active_list = chunk;
+		// Merge threaded_free such that we can detect chunks that became fully free.
+		slab_chunk_merge(chunk);
+		if (chunk->owner_count == chunk->object_count) {
+			chunk->location = chunk_location::none;
+			slab_chunk_make_empty(bkt, chunk);
+			return;
+		}
+
+		// Add to active_tree.
+		chunk->location = chunk_location::active;
+		bkt->active_tree.insert(chunk);
 	}
 
-	// Pop a chunk from active_list into head_chunk.
+	// Move the lowest chunk of active_tree into head_chunk.
 	// This is called when no head_chunk exists.
 	// We also merge threaded_free into owner_free here.
 	frg::expected<error> slab_chunk_refresh(bucket *bkt) {
 		FRG_ASSERT(!bkt->head_chunk);
 
-		// If there is no active_list, create a new chunk.
-		if (!bkt->active_list)
-			return slab_chunk_create(bkt);
+		// If there is no active_tree, adopt ORPHANED chunks, reuse an EMPTY chunk or create a new chunk.
+		if (!bkt->active_tree.get_root() && bkt->empty_list.empty())
+			slab_bucket_adopt(bkt);
 
-		// Pop from active_list.
-		chunk_header *chunk = bkt->active_list;
-		bkt->active_list = chunk->next_in_list;
+		if (!bkt->active_tree.get_root()) {
+			if (bkt->empty_list.empty())
+				return slab_chunk_create(bkt);
 
-		// Obtain threaded_free and append it to owner_free.
-		chunk_state current_state = chunk->state.exchange(
-			chunk_state{
-				.threaded_free{0},
-				.threaded_count{0},
-				.inactive{false},
-			},
-			std::memory_order_acquire
-		);
-		FRG_ASSERT(!current_state.inactive);
+			chunk_header *chunk = bkt->empty_list.pop_front();
+			bkt->num_empty--;
+			chunk->location = chunk_location::head;
+			bkt->head_chunk = chunk;
+			slab_chunk_decay(bkt);
+			return {};
+		}
 
-		if (current_state.threaded_free) {
-			// Find the end of the threaded_free list.
-			auto tail = static_cast<free_object *>(object_from_address(chunk, current_state.threaded_free));
-			size_t objs_seen = 1;
-			while (tail->next) {
-				tail = static_cast<free_object *>(object_from_address(chunk, tail->next));
-				++objs_seen;
-			}
-			FRG_ASSERT(objs_seen == current_state.threaded_count);
+		// Take the first fit from active_tree.
+		chunk_header *chunk = bkt->active_tree.first();
+		bkt->active_tree.remove(chunk);
 
-			tail->next = chunk->owner_free;
-			chunk->owner_free = current_state.threaded_free;
-			chunk->owner_count += current_state.threaded_count;
-		}
-		FRG_ASSERT(chunk->owner_free);
+		slab_chunk_merge(chunk);
 		FRG_ASSERT(chunk->owner_count);
 
+		chunk->location = chunk_location::head;
 		bkt->head_chunk = chunk;
+		slab_chunk_decay(bkt);
 		return {};
 	}
 
@@ -375,30 +1183,64 @@ private:
 
 		auto chunk = bkt->head_chunk;
 		bkt->head_chunk = nullptr;
+		slab_chunk_deactivate(bkt, chunk);
+	}
+
+	// Transition a chunk with zero owner_count that is not on any list to INACTIVE.
+	// If enough objects are on threaded_free, the chunk is made ACTIVE instead.
+	void slab_chunk_deactivate(bucket *bkt, chunk_header *chunk) {
+		FRG_ASSERT(!chunk->owner_count);
 
 		chunk_state current_state = chunk->state.load(std::memory_order_relaxed);
 		chunk_state new_state;
 		do {
 			// Too many objects in threaded_free, keep as ACTIVE.
-			if (current_state.threaded_count >= reactivate_threshold) {
-				chunk->next_in_list = bkt->active_list;
-				bkt->active_list = chunk;
+			if (current_state.threaded_count >= reactivate_count(chunk)) {
+				chunk->location = chunk_location::active;
+				bkt->active_tree.insert(chunk);
 				return;
 			}
 
 			// Transition to INACTIVE.
 			new_state = chunk_state{
 				.threaded_free{current_state.threaded_free},
+				.threaded_tail{current_state.threaded_tail},
 				.threaded_count{current_state.threaded_count},
+				.orphaned{false},
 				.inactive{true},
 			};
 		} while (!chunk->state.compare_exchange_weak(
 			current_state, new_state,
 			std::memory_order_release,
 			std::memory_order_relaxed));
+		chunk->location = chunk_location::none;
+	}
+
+	// Take an object from owner_free, or carve off a new object if owner_free is empty.
+	free_object *slab_chunk_pop(chunk_header *chunk) {
+		FRG_ASSERT(chunk->owner_count);
+		chunk->owner_count--;
+
+		if (chunk->owner_free) {
+			auto free_obj = static_cast<free_object *>(object_from_address(chunk, chunk->owner_free));
+			chunk->owner_free = free_obj->next;
+			return free_obj;
+		}
+
+		auto ca = chunk->carve;
+		FRG_ASSERT(ca + chunk->object_size <= chunk_size);
+		chunk->carve += chunk->object_size;
+		count_stats([&] (auto &stats) {
+			stats.buckets[bucket_index(chunk->bkt)].bytes_carved.add(chunk->object_size);
+		});
+		if constexpr (slab::has_poisoning_support<P>)
+			policy_.unpoison(object_from_address(chunk, ca), sizeof(free_object));
+		return new (object_from_address(chunk, ca)) free_object{};
 	}
 
 	frg::expected<error, void *> slab_allocate(bucket *bkt, size_t size) {
+		clock_++;
+		slab_remote_flush_stale();
 		slab_chunk_update(bkt);
 
 		// Ensure that we have a chunk to allocate from.
@@ -409,17 +1251,12 @@ private:
 		}
 		FRG_ASSERT(bkt->head_chunk);
 
-		// Pop an object from head_chunk's owner_free list.
+		// Pop an object from head_chunk.
 		auto chunk = bkt->head_chunk;
-		FRG_ASSERT(chunk->owner_free);
-		FRG_ASSERT(chunk->owner_count);
-		auto ca = chunk->owner_free;
-		auto free_obj = static_cast<free_object *>(object_from_address(chunk, ca));
-		chunk->owner_free = free_obj->next;
-		chunk->owner_count--;
+		auto free_obj = slab_chunk_pop(chunk);
 
-		// Retire chunks once the free list becomes empty.
-		if (!chunk->owner_free)
+		// Retire chunks once they run out of objects.
+		if (!chunk->owner_count)
 			slab_chunk_retire(bkt);
 
 		void *obj = free_obj;
@@ -428,75 +1265,215 @@ private:
 			policy_.unpoison(obj, size);
 		}
 
+		count_stats([&] (auto &stats) {
+			stats.buckets[bucket_index(bkt)].allocations.add(1);
+			stats.buckets[bucket_index(bkt)].bytes_allocated.add(bkt->object_size);
+		});
 		return obj;
 	}
 
+	// Like slab_allocate() but pops runs of objects off each chunk.
+	size_t slab_allocate_bulk(bucket *bkt, size_t size, frg::span<void *> objects) {
+		clock_ += objects.size();
+		slab_remote_flush_stale();
+		slab_chunk_update(bkt);
+
+		size_t n = 0;
+		while (n < objects.size()) {
+			if (!bkt->head_chunk) [[unlikely]] {
+				auto result = slab_chunk_refresh(bkt);
+				if (!result)
+					break;
+			}
+			FRG_ASSERT(bkt->head_chunk);
+
+			auto chunk = bkt->head_chunk;
+			size_t run = objects.size() - n;
+			if (run > chunk->owner_count)
+				run = chunk->owner_count;
+
+			for (size_t i = 0; i < run; i++) {
+				void *obj = slab_chunk_pop(chunk);
+				if constexpr (slab::has_poisoning_support<P>) {
+					policy_.poison(obj, sizeof(free_object));
+					policy_.unpoison(obj, size);
+				}
+				objects[n++] = obj;
+			}
+
+			// Retire chunks once they run out of objects.
+			if (!chunk->owner_count)
+				slab_chunk_retire(bkt);
+		}
+
+		count_stats([&] (auto &stats) {
+			stats.buckets[bucket_index(bkt)].allocations.add(n);
+			stats.buckets[bucket_index(bkt)].bytes_allocated.add(n * bkt->object_size);
+		});
+		return n;
+	}
+
 	void slab_deallocate_owned(chunk_header *chunk, void *object) {
 		auto ca = object_to_address(chunk, object);
-
-		if constexpr (slab::has_poisoning_support<P>) {
-			policy_.unpoison_expand(object, chunk->bkt->object_size);
-			policy_.poison(object, chunk->bkt->object_size);
-			policy_.unpoison(object, sizeof(free_object));
+		auto obj = slab_prepare_free(chunk, object);
+
+		clock_++;
+		slab_remote_flush_stale();
+		count_stats([&] (auto &stats) {
+			stats.buckets[bucket_index(chunk->bkt)].frees.add(1);
+			stats.buckets[bucket_index(chunk->bkt)].bytes_freed.add(chunk->object_size);
+		});
+
+		// Chunks that are not on any of the owner's lists are INACTIVE (or were transitioned
+		// to PENDING by another thread). The owner does not touch owner_count of such chunks
+		// and pushes onto threaded_free instead. Hence, owner_count is zero while a chunk is
+		// INACTIVE and threaded_count alone tells other threads whether it became fully free.
+		if (chunk->location == chunk_location::none) {
+			slab_deallocate_inactive(chunk, ca);
+			return;
 		}
 
 		// Owner deallocation: push onto owner_free.
-		auto obj = new (object) free_object{};
 		obj->next = chunk->owner_free;
 		chunk->owner_free = ca;
 		chunk->owner_count++;
 
-		// If chunk is INACTIVE and owner_count exceeds threshold, transition to PENDING.
-		if (!(chunk->owner_count >= reactivate_threshold))
-			return;
+		// If all objects are free, the chunk can become EMPTY.
+		chunk_state current_state = chunk->state.load(std::memory_order_relaxed);
+		if (chunk->owner_count + current_state.threaded_count == chunk->object_count)
+			slab_chunk_check_empty(chunk);
+	}
 
+	// Owner deallocation to a chunk that is not on any of the owner's lists: push onto
+	// threaded_free. If this transitions the chunk from INACTIVE to PENDING, the owner
+	// makes it ACTIVE (or EMPTY) right away instead of pushing it onto threaded_pending_list.
+	void slab_deallocate_inactive(chunk_header *chunk, compressed_address ca) {
+		auto obj = static_cast<free_object *>(object_from_address(chunk, ca));
 		chunk_state current_state = chunk->state.load(std::memory_order_relaxed);
 		chunk_state new_state;
 		do {
-			if (!current_state.inactive)
-				return;
-			new_state = chunk_state{
-				.threaded_free{current_state.threaded_free},
-				.threaded_count{current_state.threaded_count},
-				.inactive{false},
+			obj->next = current_state.threaded_free;
+			new_state = {
+				.threaded_free{ca},
+				.threaded_tail{current_state.threaded_free ? compressed_address(current_state.threaded_tail) : ca},
+				.threaded_count{current_state.threaded_count + uint64_t{1}},
+				.orphaned{false},
+				.inactive{current_state.inactive},
 			};
+			if (current_state.inactive && new_state.threaded_count >= reactivate_count(chunk))
+				new_state.inactive = false;
 		} while (!chunk->state.compare_exchange_weak(
 			current_state, new_state,
 			std::memory_order_release,
 			std::memory_order_relaxed));
 
-		// Push chunk onto owner_pending_list.
-		chunk->next_in_list = chunk->bkt->owner_pending_list;
-		chunk->bkt->owner_pending_list = chunk;
+		if (!(current_state.inactive && !new_state.inactive))
+			return;
+
+		slab_chunk_merge(chunk);
+		if (chunk->owner_count == chunk->object_count) {
+			slab_chunk_make_empty(chunk->bkt, chunk);
+			return;
+		}
+		chunk->location = chunk_location::active;
+		chunk->bkt->active_tree.insert(chunk);
 	}
 
+	// Poison an object that is about to be freed and turn it into a free_object.
+	free_object *slab_prepare_free(chunk_header *chunk, void *object) {
+		if constexpr (slab::has_poisoning_support<P>) {
+			policy_.unpoison_expand(object, chunk->object_size);
+			policy_.poison(object, chunk->object_size);
+			policy_.unpoison(object, sizeof(free_object));
+		}
+
+		return new (object) free_object{};
+	}
+
+	// Threaded deallocation: add the object to the remote free buffer.
 	void slab_deallocate_threaded(chunk_header *chunk, void *object) {
+		auto obj = slab_prepare_free(chunk, object);
 		auto ca = object_to_address(chunk, object);
+		clock_++;
+		count_stats([&] (auto &stats) {
+			auto &c = stats.buckets[policy_traits::size_to_bucket(chunk->object_size)];
+			c.remote_frees.add(1);
+			c.bytes_freed.add(chunk->object_size);
+		});
+
+		size_t k = 0;
+		while (k < num_remote_groups_ && remote_groups_[k].chunk != chunk)
+			k++;
+
+		if (k == num_remote_groups_) {
+			if (num_remote_groups_ == remote_free_groups) {
+				// Evict groups in round-robin order.
+				k = next_remote_eviction_;
+				next_remote_eviction_ = (next_remote_eviction_ + 1) % remote_free_groups;
+				slab_remote_group_flush(remote_groups_[k]);
+			} else {
+				if (!num_remote_groups_)
+					remote_flush_deadline_ = clock_ + remote_free_max_age;
+				num_remote_groups_++;
+			}
+			remote_groups_[k] = {.chunk = chunk, .head = ca, .tail = ca, .count = 1};
+		} else {
+			auto &g = remote_groups_[k];
+			obj->next = g.head;
+			g.head = ca;
+			g.count++;
+		}
 
-		if constexpr (slab::has_poisoning_support<P>) {
-			policy_.unpoison_expand(object, chunk->bkt->object_size);
-			policy_.poison(object, chunk->bkt->object_size);
-			policy_.unpoison(object, sizeof(free_object));
+		// Flush full groups immediately, such that the owner sees the objects.
+		if (remote_groups_[k].count == remote_free_batch) {
+			slab_remote_group_flush(remote_groups_[k]);
+			remote_groups_[k] = remote_groups_[--num_remote_groups_];
+			if (next_remote_eviction_ >= num_remote_groups_)
+				next_remote_eviction_ = 0;
+			if (!num_remote_groups_)
+				remote_flush_deadline_ = ~uint64_t{0};
+			return;
 		}
 
-		// Threaded deallocation: push onto threaded_free by using CAS.
-		auto obj = new (object) free_object{};
+		slab_remote_flush_stale();
+	}
+
+	void slab_remote_group_flush(remote_group &g) {
+		slab_deallocate_threaded_list(g.chunk, g.head, g.tail, g.count);
+	}
+
+	// Flush all buffered remote frees once the oldest one exceeds remote_free_max_age.
+	// Otherwise, the owners of their chunks could not reuse them (or release the chunks).
+	void slab_remote_flush_stale() {
+		if (clock_ >= remote_flush_deadline_) [[unlikely]]
+			flush();
+	}
 
+	// Push a pre-linked list of count objects onto threaded_free by using CAS.
+	// head is the first object of the list, tail is the last object.
+	void slab_deallocate_threaded_list(chunk_header *chunk, compressed_address head,
+			compressed_address tail, uint32_t count) {
+		auto tail_obj = static_cast<free_object *>(object_from_address(chunk, tail));
 		chunk_state current_state = chunk->state.load(std::memory_order_relaxed);
 		chunk_state new_state;
 		do {
-			obj->next = current_state.threaded_free;
+			tail_obj->next = current_state.threaded_free;
 			new_state = {
-				.threaded_free{ca},
-				.threaded_count{current_state.threaded_count + 1u},
+				.threaded_free{head},
+				.threaded_tail{current_state.threaded_free ? compressed_address(current_state.threaded_tail) : tail},
+				.threaded_count{current_state.threaded_count + count},
+				.orphaned{current_state.orphaned},
 				.inactive{current_state.inactive},
 			};
 			// If INACTIVE and count exceeds threshold, transition to PENDING.
-			if (current_state.inactive && new_state.threaded_count >= reactivate_threshold)
+			// Since owner_count is zero for INACTIVE chunks, this includes chunks
+			// that became fully free (reactivate_count() never exceeds object_count).
+			if (current_state.inactive && new_state.threaded_count >= reactivate_count(chunk))
 				new_state.inactive = false;
 		} while (!chunk->state.compare_exchange_weak(
 			current_state, new_state,
-			std::memory_order_release,
+			// Acquire ordering is required to observe chunk->bkt if the owner changed.
+			std::memory_order_acq_rel,
 			std::memory_order_relaxed));
 
 		// If we transitioned from INACTIVE, push chunk onto threaded_pending_list.
@@ -512,18 +1489,204 @@ private:
 			std::memory_order_relaxed));
 	}
 
-	frg::expected<error, void *> large_allocate(size_t size) {
+	// Move all ORPHANED chunks of the bucket's size class to the bucket.
+	void slab_bucket_adopt(bucket *bkt) {
+		auto &orphans = *bkt->orphans;
+		if (!orphans.load(std::memory_order_relaxed))
+			return;
+
+		chunk_header *chunk = orphans.exchange(nullptr, std::memory_order_acquire);
+		while (chunk) {
+			auto next = chunk->next_in_list;
+			chunk->next_in_list = nullptr;
+			FRG_ASSERT(chunk->object_size == bkt->object_size);
+
+			chunk->bkt = bkt;
+			chunk->owner.store(this, std::memory_order_relaxed);
+			bkt->chunks.push_back(chunk);
+
+			// Clear chunk_state::orphaned and merge threaded_free.
+			chunk_state current_state = chunk->state.exchange(
+				chunk_state{
+					.threaded_free{0},
+					.threaded_tail{0},
+					.threaded_count{0},
+					.orphaned{false},
+					.inactive{false},
+				},
+				std::memory_order_acq_rel
+			);
+			FRG_ASSERT(current_state.orphaned);
+			FRG_ASSERT(!current_state.inactive);
+			slab_chunk_splice(chunk, current_state);
+
+			if (chunk->owner_count == chunk->object_count) {
+				slab_chunk_make_empty(bkt, chunk);
+			} else if (chunk->owner_count) {
+				chunk->location = chunk_location::active;
+				bkt->active_tree.insert(chunk);
+			} else {
+				slab_chunk_deactivate(bkt, chunk);
+			}
+
+			chunk = next;
+		}
+	}
+
+	// Releases or orphans a chunk that is not INACTIVE and not on any list except for bucket::chunks.
+	// No other thread can transition the chunk to PENDING.
+	void slab_chunk_orphan(chunk_header *chunk) {
+		chunk->location = chunk_location::none;
+
+		chunk_state current_state = chunk->state.load(std::memory_order_relaxed);
+		chunk_state new_state;
+		do {
+			FRG_ASSERT(!current_state.inactive);
+			if (chunk->owner_count + current_state.threaded_count == chunk->object_count) {
+				// All objects are free, hence no other thread can modify the state concurrently.
+				chunk->state.store(chunk_state{}, std::memory_order_relaxed);
+				slab_chunk_splice(chunk, current_state);
+				slab_chunk_release(chunk);
+				return;
+			}
+
+			new_state = chunk_state{
+				.threaded_free{current_state.threaded_free},
+				.threaded_tail{current_state.threaded_tail},
+				.threaded_count{current_state.threaded_count},
+				.orphaned{true},
+				.inactive{false},
+			};
+		} while (!chunk->state.compare_exchange_weak(
+			current_state, new_state,
+			std::memory_order_acq_rel,
+			std::memory_order_relaxed));
+
+		auto &orphans = *chunk->bkt->orphans;
+		chunk->bkt->chunks.erase(chunk->bkt->chunks.iterator_to(chunk));
+		chunk->bkt = nullptr;
+		chunk->owner.store(nullptr, std::memory_order_relaxed);
+
+		chunk_header *current_list = orphans.load(std::memory_order_relaxed);
+		do {
+			chunk->next_in_list = current_list;
+		} while (!orphans.compare_exchange_weak(
+			current_list, chunk,
+			std::memory_order_release,
+			std::memory_order_relaxed));
+	}
+
+	void slab_bucket_teardown(bucket *bkt) {
+		// Chunks that other threads transitioned from INACTIVE to PENDING.
+		// These are either on threaded_pending_list already or they will be pushed there soon.
+		size_t num_pending = 0;
+
+		auto it = bkt->chunks.begin();
+		while (it != bkt->chunks.end()) {
+			auto chunk = *it;
+			++it;
+
+			switch (chunk->location) {
+			case chunk_location::head:
+				bkt->head_chunk = nullptr;
+				break;
+			case chunk_location::active:
+				bkt->active_tree.remove(chunk);
+				break;
+			case chunk_location::owner_pending:
+				bkt->owner_pending_list.erase(bkt->owner_pending_list.iterator_to(chunk));
+				break;
+			case chunk_location::empty:
+				bkt->empty_list.erase(bkt->empty_list.iterator_to(chunk));
+				bkt->num_empty--;
+				chunk->location = chunk_location::none;
+				slab_chunk_release(chunk);
+				continue;
+			case chunk_location::none: {
+				// Try to transition the chunk from INACTIVE to ORPHANED.
+				// This fails if another thread concurrently transitions the chunk to PENDING.
+				chunk_state current_state = chunk->state.load(std::memory_order_relaxed);
+				bool pending = false;
+				while (true) {
+					if (!current_state.inactive) {
+						pending = true;
+						break;
+					}
+					if (chunk->state.compare_exchange_weak(
+							current_state,
+							chunk_state{
+								.threaded_free{current_state.threaded_free},
+								.threaded_tail{current_state.threaded_tail},
+								.threaded_count{current_state.threaded_count},
+								.orphaned{false},
+								.inactive{false},
+							},
+							std::memory_order_acquire,
+							std::memory_order_relaxed))
+						break;
+				}
+				if (pending) {
+					num_pending++;
+					continue;
+				}
+				break;
+			}
+			}
+
+			slab_chunk_orphan(chunk);
+		}
+
+		// Wait until all PENDING chunks appear on threaded_pending_list.
+		while (num_pending) {
+			chunk_header *chunk = bkt->threaded_pending_list.exchange(nullptr, std::memory_order_acquire);
+			while (chunk) {
+				auto next = chunk->next_in_list;
+				chunk->next_in_list = nullptr;
+				FRG_ASSERT(num_pending);
+				num_pending--;
+				slab_chunk_orphan(chunk);
+				chunk = next;
+			}
+		}
+
+		FRG_ASSERT(bkt->chunks.empty());
+		FRG_ASSERT(!bkt->head_chunk);
+		FRG_ASSERT(!bkt->active_tree.get_root());
+		FRG_ASSERT(bkt->owner_pending_list.empty());
+		FRG_ASSERT(bkt->empty_list.empty());
+	}
+
+	frg::expected<error, void *> large_allocate(size_t size, size_t object_alignment) {
+		FRG_ASSERT(object_alignment >= page_size);
+		FRG_ASSERT(object_alignment < chunk_boundary);
+
 		// Compute the space needed after alignment.
-		// Object starts after chunk_header, aligned to page boundary for large objects.
-		size_t object_alignment = 4096;
+		// Object starts after chunk_header, aligned to object_alignment (at least a page) for large objects.
 		size_t first_offset = (sizeof(chunk_header) + object_alignment - 1) & ~(object_alignment - 1);
 		size_t data_size = first_offset + size;
 
-		// Over-allocate to ensure we can align to chunk_boundary.
-		auto extent_size = (data_size + chunk_boundary - 1 + page_size - 1) & ~(page_size - 1);
-		auto extent_ptr = policy_.map(extent_size);
-		if (!extent_ptr)
-			return error::allocation_failed;
+		// Reuse a cached extent if possible.
+		// Unless extents are aligned, over-allocate to ensure we can align to chunk_boundary.
+		size_t extent_size;
+		if constexpr (aligned_large_extents) {
+			extent_size = (data_size + page_size - 1) & ~(page_size - 1);
+		} else {
+			extent_size = (data_size + chunk_boundary - 1 + page_size - 1) & ~(page_size - 1);
+		}
+		void *extent_ptr;
+		size_t cached_size;
+		if (auto base = large_cache_.take(extent_size, cached_size); base) {
+			extent_ptr = reinterpret_cast<void *>(base);
+			extent_size = cached_size;
+			if constexpr (slab::has_poisoning_support<P>)
+				policy_.poison(extent_ptr, large_cache_type::entry_size);
+		} else {
+			auto mapping = large_map(data_size);
+			extent_ptr = mapping.ptr;
+			extent_size = mapping.size;
+			if (!extent_ptr)
+				return error::allocation_failed;
+		}
 
 		// Align up to chunk_boundary.
 		auto raw_addr = reinterpret_cast<uintptr_t>(extent_ptr);
@@ -542,23 +1705,461 @@ private:
 			.extent_size{extent_size},
 		};
 
+		count_stats([&] (auto &stats) {
+			stats.large.allocations.add(1);
+			stats.large.bytes_allocated.add(extent_size);
+		});
 		return reinterpret_cast<void *>(aligned_addr + first_offset);
 	}
 
+	// Resize the extent of a large object using P::remap().
+	// If the extent moves, the chunk is re-aligned to chunk_boundary within the new extent.
+	// Returns nullptr if the extent was not remapped.
+	void *large_remap(chunk_header *chunk, void *object, size_t new_size) {
+		auto *extent_ptr = chunk->extent_ptr;
+		size_t extent_size = chunk->extent_size;
+		auto extent_addr = reinterpret_cast<uintptr_t>(extent_ptr);
+		auto chunk_offset = reinterpret_cast<uintptr_t>(chunk) - extent_addr;
+		auto first_offset = reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(chunk);
+		size_t capacity = extent_size - chunk_offset - first_offset;
+
+		// Same computation as in large_allocate(), such that the chunk can be re-aligned.
+		auto new_extent_size = (first_offset + new_size + chunk_boundary - 1 + page_size - 1)
+				& ~(page_size - 1);
+		if (new_size <= capacity) {
+			// Only shrink the extent if that releases at least half of it.
+			if (2 * new_extent_size > extent_size)
+				return nullptr;
+		}
+
+		// Extents in the arena cannot be remapped, see large_unmap().
+		if constexpr (enable_arena) {
+			if (extent_size <= max_arena_extent || new_extent_size <= max_arena_extent)
+				return nullptr;
+		}
+
+		auto new_extent_ptr = policy_.remap(extent_ptr, extent_size, new_extent_size);
+		if (!new_extent_ptr)
+			return nullptr;
+
+		if constexpr (slab::has_poisoning_support<P>) {
+			policy_.poison(extent_ptr, extent_size);
+			policy_.unpoison_expand(new_extent_ptr, new_extent_size);
+		}
+
+		// The object only needs to be moved if the extent moved to an address
+		// that is aligned differently (relative to chunk_boundary) than the old one.
+		auto new_extent_addr = reinterpret_cast<uintptr_t>(new_extent_ptr);
+		auto aligned_addr = (new_extent_addr + chunk_boundary - 1) & ~(chunk_boundary - 1);
+		if (aligned_addr != new_extent_addr + chunk_offset)
+			memmove(reinterpret_cast<void *>(aligned_addr + first_offset),
+					reinterpret_cast<void *>(new_extent_addr + chunk_offset + first_offset),
+					capacity < new_size ? capacity : new_size);
+		FRG_ASSERT(aligned_addr + first_offset + new_size <= new_extent_addr + new_extent_size);
+
+		auto new_chunk = reinterpret_cast<chunk_header *>(aligned_addr);
+		auto new_object = reinterpret_cast<void *>(aligned_addr + first_offset);
+		new (new_chunk) chunk_header{
+			.type{chunk_type::large},
+			.owner{this},
+			.extent_ptr{new_extent_ptr},
+			.extent_size{new_extent_size},
+		};
+
+		if constexpr (slab::has_poisoning_support<P>) {
+			policy_.poison(new_extent_ptr, new_extent_size);
+			policy_.unpoison(new_chunk, sizeof(chunk_header));
+			policy_.unpoison(new_object, new_size);
+		}
+
+		count_stats([&] (auto &stats) {
+			stats.large.bytes_freed.add(extent_size);
+			stats.large.bytes_allocated.add(new_extent_size);
+		});
+
+		return new_object;
+	}
+
 	void large_free(chunk_header *chunk) {
 		auto *extent_ptr = chunk->extent_ptr;
 		size_t extent_size = chunk->extent_size;
+		count_stats([&] (auto &stats) {
+			stats.large.frees.add(1);
+			stats.large.bytes_freed.add(extent_size);
+		});
 
 		if constexpr (slab::has_poisoning_support<P>) {
 			policy_.unpoison_expand(extent_ptr, extent_size);
 			policy_.poison(extent_ptr, extent_size);
+			policy_.unpoison(extent_ptr, large_cache_type::entry_size);
 		}
 
-		policy_.unmap(extent_ptr, extent_size);
+		// Extents that were moved by large_remap() (or mapped without aligned map support)
+		// are not aligned. Do not cache them since large_allocate() expects aligned extents.
+		if constexpr (aligned_large_extents) {
+			if (reinterpret_cast<uintptr_t>(extent_ptr) & (chunk_boundary - 1)) {
+				large_unmap(reinterpret_cast<uintptr_t>(extent_ptr), extent_size);
+				return;
+			}
+		}
+
+		large_cache_.put(reinterpret_cast<uintptr_t>(extent_ptr), extent_size,
+			[&] (uintptr_t base, size_t size) {
+				large_unmap(base, size);
+			});
+	}
+
+	// Map an extent for a large object with data_size bytes (including its chunk_header).
+	// Small enough extents are taken from the arena.
+	aligned_mapping large_map(size_t data_size) {
+		if constexpr (enable_arena) {
+			auto arena_size = (data_size + chunk_boundary - 1) & ~(chunk_boundary - 1);
+			if (arena_size <= max_arena_extent) {
+				auto ptr = arena_.take(policy_, arena_size);
+				return {ptr, arena_size, reinterpret_cast<uintptr_t>(ptr)};
+			}
+		}
+		return map_aligned(policy_, (data_size + page_size - 1) & ~(page_size - 1), chunk_boundary);
 	}
 
+	// Extents up to max_arena_extent were taken from the arena, larger ones were mapped.
+	void large_unmap(uintptr_t base, size_t size) {
+		if constexpr (slab::has_poisoning_support<P>)
+			policy_.poison(reinterpret_cast<void *>(base), large_cache_type::entry_size);
+		if constexpr (enable_arena) {
+			if (size <= max_arena_extent) {
+				arena_.put(policy_, reinterpret_cast<void *>(base), size);
+				return;
+			}
+		}
+		policy_.unmap(reinterpret_cast<void *>(base), size);
+	}
+
+	// Guarded objects live in a single chunk that is shared by all pools with the same policy.
+	// The chunk_header (page 0) is followed by alternating guard and data pages, i.e.,
+	// guard pages have odd and data pages have even page indices. Each data page holds
+	// at most one object, placed at either end of the page (chosen randomly).
+	// Only the data pages of live objects are accessible.
+	struct guarded_trace {
+		uintptr_t frames[guarded_report::max_trace_depth];
+		size_t depth;
+	};
+
+	struct guarded_slot {
+		void *object;
+		size_t size;
+		bool allocated;
+		// Value of guarded_region::clock when the object was freed.
+		// Freed slots are reused in FIFO order to maximize the time in quarantine.
+		uint64_t freed_at;
+		guarded_trace allocation_trace;
+		guarded_trace deallocation_trace;
+	};
+
+	struct guarded_region {
+		// The data page of slot i is page 2 * i + 2. The last page is a guard page.
+		static constexpr size_t num_slots = chunk_size / page_size / 2 - 1;
+
+		simple_spinlock mutex;
+		chunk_header *chunk{nullptr};
+		uint64_t clock{0};
+		guarded_slot slots[num_slots]{};
+	};
+
+	void guarded_capture(guarded_trace &trace) {
+		trace.depth = 0;
+		if constexpr (requires { policy_.walk_stack([] (uintptr_t) {}); }) {
+			policy_.walk_stack([&] (uintptr_t frame) {
+				if (trace.depth < guarded_report::max_trace_depth)
+					trace.frames[trace.depth++] = frame;
+			});
+		}
+	}
+
+	// Maps the guarded region if that did not happen yet.
+	chunk_header *guarded_chunk() {
+		auto &g = guarded_;
+		{
+			unique_lock<simple_spinlock> guard(g.mutex);
+			if (g.chunk)
+				return g.chunk;
+		}
+
+		auto mapping = map_aligned(policy_, chunk_size, chunk_boundary);
+		if (!mapping.ptr)
+			return nullptr;
+		auto chunk = new (reinterpret_cast<void *>(mapping.aligned_addr)) chunk_header{
+			.type{chunk_type::guarded},
+			.extent_ptr{mapping.ptr},
+			.extent_size{mapping.size},
+		};
+		policy_.protect(reinterpret_cast<void *>(mapping.aligned_addr + page_size),
+				chunk_size - page_size);
+
+		// Another pool might have mapped the region concurrently.
+		unique_lock<simple_spinlock> guard(g.mutex);
+		if (!g.chunk) {
+			g.chunk = chunk;
+			return chunk;
+		}
+		auto existing = g.chunk;
+		guard.unlock();
+		policy_.unmap(mapping.ptr, mapping.size);
+		return existing;
+	}
+
+	// Called once guarded_countdown_ expires. Returns nullptr if the allocation
+	// should not be sampled, or if all slots are in use.
+	void *guarded_allocate(bucket *bkt, size_t size) {
+		// The first call only seeds the sampler.
+		if (!guarded_seeded_) {
+			guarded_rng_.seed(reinterpret_cast<uintptr_t>(this));
+			guarded_seeded_ = true;
+			guarded_countdown_ = 1 + guarded_rng_(2 * guarded_sample_interval - 1);
+			return nullptr;
+		}
+		guarded_countdown_ = 1 + guarded_rng_(2 * guarded_sample_interval - 1);
+
+		if (size > page_size)
+			return nullptr;
+		auto chunk = guarded_chunk();
+		if (!chunk)
+			return nullptr;
+
+		// Preserve the alignment that the object would have in a slab.
+		size_t alignment = bkt->object_size & -bkt->object_size;
+		if (alignment > page_size)
+			alignment = page_size;
+		size_t footprint = ((size ? size : 1) + alignment - 1) & ~(alignment - 1);
+
+		// Right-aligned objects catch overflows, left-aligned objects catch underflows.
+		bool left_aligned = guarded_rng_(2);
+
+		guarded_trace trace;
+		guarded_capture(trace);
+
+		// Take an unused slot or the slot that was freed least recently.
+		auto &g = guarded_;
+		unique_lock<simple_spinlock> guard(g.mutex);
+		guarded_slot *slot = nullptr;
+		for (auto &candidate : g.slots) {
+			if (candidate.allocated)
+				continue;
+			if (!slot || !candidate.object || candidate.freed_at < slot->freed_at)
+				slot = &candidate;
+			if (!candidate.object)
+				break;
+		}
+		if (!slot)
+			return nullptr;
+
+		auto page = reinterpret_cast<uintptr_t>(chunk) + (2 * (slot - g.slots) + 2) * page_size;
+		auto object = reinterpret_cast<void *>(page + page_size - footprint);
+		if (left_aligned)
+			object = reinterpret_cast<void *>(page);
+		slot->object = object;
+		slot->size = size;
+		slot->allocated = true;
+		slot->allocation_trace = trace;
+		slot->deallocation_trace.depth = 0;
+		guard.unlock();
+
+		policy_.unprotect(reinterpret_cast<void *>(page), page_size);
+		return object;
+	}
+
+	void guarded_free(void *object) {
+		auto &g = guarded_;
+		auto addr = reinterpret_cast<uintptr_t>(object);
+		auto page = addr & ~(page_size - 1);
+		size_t index = (page - reinterpret_cast<uintptr_t>(g.chunk)) / page_size / 2 - 1;
+		auto slot = &g.slots[index];
+		{
+			unique_lock<simple_spinlock> guard(g.mutex);
+			FRG_ASSERT(slot->allocated && slot->object == object);
+		}
+
+		// The slot stays allocated until the page is protected, such that
+		// guarded_allocate() cannot hand it out concurrently.
+		guarded_trace trace;
+		guarded_capture(trace);
+		policy_.protect(reinterpret_cast<void *>(page), page_size);
+
+		unique_lock<simple_spinlock> guard(g.mutex);
+		slot->allocated = false;
+		slot->freed_at = ++g.clock;
+		slot->deallocation_trace = trace;
+	}
+
+	// Usable size of a guarded object, i.e., the bytes until the guard page.
+	size_t guarded_capacity(void *object) {
+		auto addr = reinterpret_cast<uintptr_t>(object);
+		return ((addr + page_size) & ~(page_size - 1)) - addr;
+	}
+
+	// ORPHANED chunks of each size class. Shared by all pools with the same policy.
+	static inline std::atomic<chunk_header *> orphan_lists_[policy_traits::num_buckets]{};
+
+	// Superblocks that chunks and large extents are taken from (if enable_arena).
+	static inline superblock_arena arena_;
+
+	static inline guarded_region guarded_;
+
+	using large_cache_type = slab::extent_cache<page_size, large_cache_bytes, large_cache_decay>;
+
 	P policy_;
 	bucket buckets_[policy_traits::num_buckets];
+	large_cache_type large_cache_;
+	// Counts allocations and deallocations. Used to age EMPTY chunks.
+	uint64_t clock_{0};
+	remote_group remote_groups_[remote_free_groups];
+	size_t num_remote_groups_{0};
+	size_t next_remote_eviction_{0};
+	// Value of clock_ at which buffered remote frees are flushed, see slab_remote_flush_stale().
+	uint64_t remote_flush_deadline_{~uint64_t{0}};
+	// Number of small allocations until the next one is sampled, see guarded_allocate().
+	size_t guarded_countdown_{1};
+	bool guarded_seeded_{false};
+	pcg_basic32 guarded_rng_{0};
+	[[no_unique_address]] slab::stats_counters<policy_traits::num_buckets,
+			true, enable_stats> stats_;
+};
+
+// Statistics of an object_cache, see object_cache::stats().
+struct object_cache_stats {
+	// Size of the cache's objects and size of the bucket that pool::allocate() would use instead.
+	size_t object_size{0};
+	size_t bucket_size{0};
+	// Number of allocations and the number of those that were served by constructed objects.
+	uint64_t allocations{0};
+	uint64_t hits{0};
+	uint64_t frees{0};
+	// Number of constructor and destructor calls.
+	uint64_t constructions{0};
+	uint64_t destructions{0};
+	// Number of constructed objects that are currently cached.
+	size_t cached{0};
+};
+
+// Per-type object cache on top of a pool, in the style of Bonwick's slab allocator.
+// Objects are carved from a dedicated bucket whose object_size is the exact size of T
+// (instead of the size of the pool's next larger bucket). Freed objects are kept in
+// their constructed state: deallocate() only calls obj.reset() (if T has such a member)
+// and allocate() returns objects that are default constructed or reset.
+// Since free slab objects store the free list inline, only up to MaxCached objects are
+// cached in constructed state; beyond that, objects are destructed and returned to the bucket.
+//
+// Like the pool, the cache is not thread-safe. Each pool should have its own cache
+// and the cache must be destroyed before its pool. Objects can be deallocated to any
+// cache of the same type or (after destructing them) to pool::deallocate() of any pool.
+template<typename T, Policy P, size_t MaxCached = 64>
+struct object_cache {
+private:
+	using pool_type = pool<P>;
+	using policy_traits = typename pool_type::policy_traits;
+
+	static constexpr size_t aligned_size = (sizeof(T) + alignof(T) - 1) & ~(alignof(T) - 1);
+
+public:
+	// Objects are aligned to the largest power of two that divides object_size.
+	// This is a multiple of alignof(T) and at least large enough for the free list.
+	static constexpr size_t object_size = aligned_size < policy_traits::tiny_sizes[0]
+			? policy_traits::tiny_sizes[0] : aligned_size;
+
+	static_assert(std::is_default_constructible_v<T>);
+	static_assert(alignof(T) < pool_type::page_size);
+	static_assert(object_size <= policy_traits::max_bucket_size,
+			"Objects that do not fit into a bucket should be allocated with pool::allocate()");
+
+	explicit object_cache(pool_type &pool)
+	: pool_{pool} {
+		bucket_.object_size = object_size;
+		bucket_.orphans = &orphans_;
+		bucket_.stats_index = policy_traits::size_to_bucket(object_size);
+	}
+
+	object_cache(const object_cache &) = delete;
+
+	object_cache &operator= (const object_cache &) = delete;
+
+	// Destructs all cached objects. Releases all chunks that are fully free
+	// and orphans all other chunks, such that they can be adopted by other caches of T.
+	~object_cache() {
+		reclaim();
+		pool_.slab_bucket_teardown(&bucket_);
+	}
+
+	// Returns a constructed object or nullptr if the policy fails to map memory.
+	T *allocate() {
+		count_stats([&] (auto &stats) { stats.allocations++; });
+		if (num_cached_) {
+			count_stats([&] (auto &stats) { stats.hits++; });
+			return cached_[--num_cached_];
+		}
+
+		auto result = pool_.slab_allocate(&bucket_, object_size);
+		if (!result)
+			return nullptr;
+		slab::trace(pool_.policy_, 'a', result.value(), object_size);
+		count_stats([&] (auto &stats) { stats.constructions++; });
+		return new (result.value()) T();
+	}
+
+	// Returns an object (that was allocated by any cache of T) to the cache.
+	void deallocate(T *obj) {
+		if (!obj)
+			return;
+		count_stats([&] (auto &stats) { stats.frees++; });
+		if constexpr (requires { obj->reset(); })
+			obj->reset();
+		if (num_cached_ < MaxCached) {
+			cached_[num_cached_++] = obj;
+			return;
+		}
+		destroy(obj);
+	}
+
+	// Destructs all cached objects and returns their memory to the bucket,
+	// e.g., if the system runs low on memory.
+	void reclaim() {
+		while (num_cached_)
+			destroy(cached_[--num_cached_]);
+	}
+
+	// Returns the statistics of this cache. Only available if pool::enable_stats is true.
+	// Unlike pool::snapshot(), this must not be called concurrently to allocations from the cache.
+	object_cache_stats stats() const requires (pool_type::enable_stats) {
+		auto stats = stats_;
+		stats.object_size = object_size;
+		stats.bucket_size = policy_traits::bucket_to_size(policy_traits::size_to_bucket(object_size));
+		stats.cached = num_cached_;
+		return stats;
+	}
+
+private:
+	void destroy(T *obj) {
+		obj->~T();
+		count_stats([&] (auto &stats) { stats.destructions++; });
+		pool_.deallocate(obj);
+	}
+
+	template<typename F>
+	void count_stats(F f) {
+		if constexpr (pool_type::enable_stats)
+			f(stats_);
+	}
+
+	struct no_stats { };
+
+	// ORPHANED chunks of all caches of T, see pool::slab_bucket_adopt().
+	static inline std::atomic<typename pool_type::chunk_header *> orphans_{nullptr};
+
+	pool_type &pool_;
+	typename pool_type::bucket bucket_;
+	T *cached_[MaxCached];
+	size_t num_cached_{0};
+	[[no_unique_address]] std::conditional_t<pool_type::enable_stats,
+			object_cache_stats, no_stats> stats_;
 };
 
 } // namespace sharded_slab
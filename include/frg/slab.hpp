@@ -2,11 +2,15 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <atomic>
 #include <frg/bitops.hpp>
 #include <frg/string_stub.hpp>
+#include <frg/list.hpp>
 #include <frg/macros.hpp>
 #include <frg/mutex.hpp>
+#include <frg/random.hpp>
 #include <frg/rbtree.hpp>
+#include <frg/spinlock.hpp>
 #include <frg/detection.hpp>
 
 namespace frg FRG_VISIBILITY {
@@ -19,18 +23,321 @@ concept has_poisoning_support = requires(P policy) {
 	policy.unpoison(nullptr, size_t{0});
 };
 
+// Policies that can identify the current CPU enable per-CPU magazines in slab_pool.
+// cpu_index() must return a value below max_cpus. It may return a stale value
+// (e.g., after migration); this only affects performance, not correctness.
+template<typename P>
+concept has_cpu_support = requires(P policy) {
+	static_cast<size_t>(policy.cpu_index());
+	static_cast<size_t>(P::max_cpus);
+};
+
+// Policies with a remap() function allow large objects to be resized without copying.
+// remap(old, old_size, new_size) resizes a mapping that was returned by map() or remap(),
+// for example using mremap() with MREMAP_MAYMOVE. It returns the (possibly moved) address
+// of the new mapping, or zero on failure. On failure, the old mapping must stay intact.
+template<typename P, typename Address>
+concept has_remap_support = requires(P policy, Address address, size_t size) {
+	static_cast<Address>(policy.remap(address, size, size));
+};
+
 template<typename Policy>
 concept has_trace_support = requires (Policy p) { p.enable_trace(); }
 	&& requires (Policy p, void *buffer, size_t size) { p.output_trace(buffer, size); }
 	&& requires (Policy p) { p.walk_stack([] (uintptr_t) {}); };
 
+// Policies that define trace_sample_interval only trace a sample of all allocations,
+// in the style of tcmalloc's heap profiler. On average, one allocation is sampled per
+// trace_sample_interval allocated bytes. Frees are only traced for sampled objects.
+template<typename Policy>
+concept has_trace_sampling = has_trace_support<Policy>
+	&& requires { static_cast<size_t>(Policy::trace_sample_interval); };
+
+// Decides which allocations are traced if has_trace_sampling<Policy> is true.
+// The state is shared by all pools with the same Policy.
+template<typename Policy>
+struct trace_sampler {
+	static constexpr size_t interval = Policy::trace_sample_interval;
+
+	// Number of sampled objects that can be live at the same time.
+	// If the table is full, allocations are not sampled.
+	static constexpr size_t num_slots = 4096;
+	static constexpr size_t probe_length = 4;
+
+	// Returns true if the allocation ('a') or free ('f') should be traced.
+	static bool sample(char c, void *ptr, size_t size) {
+		auto p = reinterpret_cast<uintptr_t>(ptr);
+		if (c != 'a')
+			return p && _remove(p);
+
+		// Count down the bytes until the next sample.
+		auto &t = _thread;
+		if (!t.initialized) {
+			t.rng.seed(reinterpret_cast<uintptr_t>(&t));
+			t.bytes_until_sample = _draw(t.rng);
+			t.initialized = true;
+		}
+		t.bytes_until_sample -= static_cast<int64_t>(size);
+		if (t.bytes_until_sample > 0)
+			return false;
+		t.bytes_until_sample = _draw(t.rng);
+		return p && _insert(p);
+	}
+
+	// Returns true exactly once, such that the interval is recorded once per trace.
+	static bool announce() {
+		return !_announced.load(std::memory_order_relaxed)
+			&& !_announced.exchange(true, std::memory_order_relaxed);
+	}
+
+private:
+	struct thread_state {
+		bool initialized{false};
+		pcg_basic32 rng{0};
+		int64_t bytes_until_sample{0};
+	};
+
+	// Draws the distance to the next sample from an exponential distribution with mean interval.
+	// Allocations of size s are thus sampled with probability 1 - exp(-s / interval).
+	static int64_t _draw(pcg_basic32 &rng) {
+		// q is uniformly distributed in [1, 2^26].
+		double q = static_cast<double>(rng() >> 6) + 1.0;
+		double bytes = (__builtin_log2(q) - 26) * (-0.6931471805599453 * interval);
+		return static_cast<int64_t>(bytes) + 1;
+	}
+
+	// The slots of each pointer are within a single group of probe_length slots.
+	static std::atomic<uintptr_t> *_group(uintptr_t p) {
+		auto h = static_cast<size_t>(((p >> 4) * 0x9E3779B97F4A7C15ULL) >> 32);
+		return &_slots[h & (num_slots - probe_length)];
+	}
+
+	static bool _insert(uintptr_t p) {
+		auto group = _group(p);
+		for (size_t k = 0; k < probe_length; k++) {
+			uintptr_t expected = 0;
+			if (group[k].compare_exchange_strong(expected, p, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	static bool _remove(uintptr_t p) {
+		auto group = _group(p);
+		for (size_t k = 0; k < probe_length; k++) {
+			uintptr_t expected = p;
+			if (group[k].load(std::memory_order_relaxed) == p
+					&& group[k].compare_exchange_strong(expected, 0, std::memory_order_relaxed))
+				return true;
+		}
+		return false;
+	}
+
+	static_assert(!(num_slots & (num_slots - 1)) && !(probe_length & (probe_length - 1)));
+
+	static inline thread_local thread_state _thread;
+	static inline std::atomic<uintptr_t> _slots[num_slots]{};
+	static inline std::atomic<bool> _announced{false};
+};
+
+// Policies that set trace_version to 2 use the compact version 2 of the trace format.
+template<typename Policy>
+concept has_trace_v2 = has_trace_support<Policy>
+	&& requires { requires Policy::trace_version == 2; };
+
+// Encoder for version 2 of the trace format.
+// The trace starts with a header that consists of the magic bytes "FRGT"
+// and the version as a varint. Each record consists of:
+// * The record type ('a', 'f', 'i' or 't').
+// * For 'i' records: the sample interval as a varint. There are no further fields.
+// * For 't' records: the number of the thread that emits the following records, as a varint.
+//   Threads are numbered in the order in which they first emit a record; 't' records are
+//   only written when the thread changes, i.e., records start out on thread zero.
+// * The pointer, as a zigzag varint of the difference to the previous record's pointer.
+// * For 'a' records: the size as a varint.
+// * A stack reference varint (id << 1) | is_new. Stacks are interned, i.e., the frames
+//   of each distinct stack are only written once (with is_new set). If is_new is set,
+//   the frame count (as a varint) and the frames follow, each frame as a zigzag varint
+//   of the difference to the previous frame (the first one relative to zero).
+//   Stacks with id zero are not interned and are written in full every time.
+// All varints are unsigned LEB128. The state of the encoder is shared by all pools
+// with the same Policy; the encoder serializes all calls to output_trace().
+template<typename Policy>
+struct trace_encoder_v2 {
+	static constexpr size_t max_frames = 12;
+	static constexpr size_t max_varint_size = 10;
+	static constexpr size_t max_record_size = 4 + max_varint_size // Header.
+		+ 1 + max_varint_size                                     // Thread.
+		+ 1 + 4 * max_varint_size                                 // Type, pointer, size, stack.
+		+ max_frames * max_varint_size;                           // Frames.
+
+	// Number of distinct stacks that can be interned.
+	static constexpr size_t num_stack_slots = 4096;
+	static constexpr size_t probe_length = 8;
+
+	static void emit(Policy &plcy, char c, uintptr_t ptr, size_t size,
+			const uintptr_t *frames, size_t num_frames) {
+		FRG_ASSERT(num_frames <= max_frames);
+		uint8_t buffer[max_record_size];
+		size_t n = 0;
+
+		auto add_varint = [&] (uint64_t val) {
+			do {
+				FRG_ASSERT(n + 1 <= max_record_size);
+				uint8_t byte = val & 0x7F;
+				val >>= 7;
+				buffer[n++] = byte | (val ? 0x80 : 0);
+			} while (val);
+		};
+
+		auto add_delta = [&] (uint64_t val, uint64_t prev) {
+			auto delta = static_cast<int64_t>(val - prev);
+			add_varint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63));
+		};
+
+		unique_lock<ticket_spinlock> guard(_mutex);
+
+		if (!_header_written) {
+			for (char m : {'F', 'R', 'G', 'T'})
+				buffer[n++] = m;
+			add_varint(2);
+			_header_written = true;
+		}
+
+		if (_thread < 0)
+			_thread = _next_thread++;
+		if (_thread != _prev_thread) {
+			buffer[n++] = 't';
+			add_varint(_thread);
+			_prev_thread = _thread;
+		}
+
+		buffer[n++] = c;
+		if (c == 'i') {
+			add_varint(size);
+			plcy.output_trace(buffer, n);
+			return;
+		}
+
+		add_delta(ptr, _prev_ptr);
+		_prev_ptr = ptr;
+		if (c == 'a')
+			add_varint(size);
+
+		auto id = _intern(frames, num_frames);
+		if (id > 0) {
+			add_varint(static_cast<uint64_t>(id) << 1);
+		} else {
+			add_varint((static_cast<uint64_t>(-id) << 1) | 1);
+			add_varint(num_frames);
+			uintptr_t prev = 0;
+			for (size_t i = 0; i < num_frames; i++) {
+				add_delta(frames[i], prev);
+				prev = frames[i];
+			}
+		}
+
+		plcy.output_trace(buffer, n);
+	}
+
+private:
+	struct stack_slot {
+		uint64_t hash;
+		uint32_t id; // Zero marks empty slots.
+		uint32_t num_frames;
+		uintptr_t frames[max_frames];
+	};
+
+	// Returns the id of a stack that was already written,
+	// or the negated id of a new stack (zero if the stack cannot be interned).
+	// Slots store the frames since distinct stacks can have the same hash;
+	// stacks that collide with an interned stack are not interned.
+	static int64_t _intern(const uintptr_t *frames, size_t num_frames) {
+		uint64_t hash = num_frames;
+		for (size_t i = 0; i < num_frames; i++)
+			hash = (hash ^ frames[i]) * 0x100000001B3ULL;
+
+		auto base = static_cast<size_t>(hash >> 32) & (num_stack_slots - 1);
+		for (size_t k = 0; k < probe_length; k++) {
+			auto &slot = _stacks[(base + k) & (num_stack_slots - 1)];
+			if (!slot.id) {
+				slot.hash = hash;
+				slot.id = _next_id++;
+				slot.num_frames = num_frames;
+				for (size_t i = 0; i < num_frames; i++)
+					slot.frames[i] = frames[i];
+				return -static_cast<int64_t>(slot.id);
+			}
+			if (slot.hash == hash) {
+				if (slot.num_frames != num_frames)
+					return 0;
+				for (size_t i = 0; i < num_frames; i++) {
+					if (slot.frames[i] != frames[i])
+						return 0;
+				}
+				return slot.id;
+			}
+		}
+		return 0;
+	}
+
+	static inline ticket_spinlock _mutex;
+	static inline bool _header_written{false};
+	static inline uintptr_t _prev_ptr{0};
+	static inline uint32_t _next_id{1};
+	static inline stack_slot _stacks[num_stack_slots]{};
+	static inline thread_local int64_t _thread{-1};
+	static inline int64_t _prev_thread{0};
+	static inline int64_t _next_thread{0};
+};
+
+// Writes a trace record for an allocation ('a') or a free ('f').
+// By default, version 1 of the trace format is used. In version 1, records consist of
+// the record type, the pointer, the size (for allocations only), the stack trace and
+// a terminator. All words are little endian 64-bit values.
+// If sampling is enabled, an 'i' record that contains the sample interval
+// (in place of the pointer) precedes the first record.
 template<typename Policy>
 void trace(Policy &plcy, char c, void *ptr, size_t size) {
 	if constexpr (has_trace_support<Policy>) {
 		if (!plcy.enable_trace())
 			return;
 
+		if constexpr (has_trace_sampling<Policy>) {
+			if (!trace_sampler<Policy>::sample(c, ptr, size))
+				return;
+
+			if (trace_sampler<Policy>::announce()) {
+				if constexpr (has_trace_v2<Policy>) {
+					trace_encoder_v2<Policy>::emit(plcy, 'i', 0,
+							trace_sampler<Policy>::interval, nullptr, 0);
+				} else {
+					uint8_t record[17];
+					record[0] = 'i';
+					for (int i = 0; i < 8; i++) {
+						record[1 + i] = (uint64_t{trace_sampler<Policy>::interval} >> (i * 8)) & 0xFF;
+						record[9 + i] = 0xA5;
+					}
+					plcy.output_trace(record, sizeof(record));
+				}
+			}
+		}
+
 		const int num_frames = 12;
+
+		if constexpr (has_trace_v2<Policy>) {
+			uintptr_t frames[num_frames];
+			size_t k = 0;
+			plcy.walk_stack([&](uintptr_t val){
+				if(k >= num_frames)
+					return;
+				frames[k++] = val;
+			});
+			trace_encoder_v2<Policy>::emit(plcy, c, reinterpret_cast<uintptr_t>(ptr),
+					size, frames, k);
+			return;
+		}
+
 		const size_t bufsize = 1 // Record type.
 			+ 16                 // Pointer and size.
 			+ num_frames * 8     // Stack trace.
@@ -68,6 +375,284 @@ void trace(Policy &plcy, char c, void *ptr, size_t size) {
 	}
 }
 
+// Hit and miss counts of an extent_cache.
+struct extent_cache_stats {
+	size_t hits;
+	size_t misses;
+};
+
+// Cache of recently freed extents that back large allocations.
+// This avoids a map/unmap pair per allocation if large objects are allocated in a loop.
+// Extents are binned by their page count. The cache holds at most MaxBytes and extents
+// are released once they were not reused for MaxAge calls to take() or put().
+// The bookkeeping is stored in the first bytes of each cached extent.
+// This class is not thread-safe.
+template<size_t PageSize, size_t MaxBytes, uint64_t MaxAge>
+struct extent_cache {
+private:
+	struct entry {
+		size_t size;
+		uint64_t since;
+		frg::default_list_hook<entry> bin_hook;
+		frg::default_list_hook<entry> age_hook;
+	};
+
+	using bin_list = frg::intrusive_list<
+		entry,
+		frg::locate_member<
+			entry,
+			frg::default_list_hook<entry>,
+			&entry::bin_hook
+		>
+	>;
+
+	using age_list = frg::intrusive_list<
+		entry,
+		frg::locate_member<
+			entry,
+			frg::default_list_hook<entry>,
+			&entry::age_hook
+		>
+	>;
+
+	// Four bins per power of two pages.
+	static constexpr size_t bin_of(size_t size) {
+		size_t pages = size / PageSize;
+		if(pages < 4)
+			return pages;
+		auto e = floor_log2(pages);
+		return 4 * (e - 1) + ((pages >> (e - 2)) & 3);
+	}
+
+	static constexpr size_t num_bins = bin_of(MaxBytes) + 1;
+
+public:
+	// Number of bytes at the start of each extent that are used for bookkeeping.
+	// Callers must ensure that these bytes are accessible before put().
+	static constexpr size_t entry_size = sizeof(entry);
+
+	// Takes an extent of at least size bytes out of the cache.
+	// Extents that are more than twice as large as size are not considered.
+	// Returns 0 if no extent is found.
+	uintptr_t take(size_t size, size_t &extent_size) {
+		_clock++;
+
+		size_t limit = 2 * size;
+		for(size_t b = bin_of(size); b < num_bins && b <= bin_of(limit); b++) {
+			for(auto e : _bins[b]) {
+				if(e->size < size || e->size > limit)
+					continue;
+				_remove(e);
+				_stats.hits++;
+				extent_size = e->size;
+				e->~entry();
+				return reinterpret_cast<uintptr_t>(e);
+			}
+		}
+
+		_stats.misses++;
+		return 0;
+	}
+
+	// Inserts an extent into the cache. Extents that exceed the cache's bounds
+	// (including possibly the new extent) are passed to release(base, size).
+	template<typename F>
+	void put(uintptr_t base, size_t size, F release) {
+		FRG_ASSERT(!(size & (PageSize - 1)));
+		_clock++;
+
+		if(size > MaxBytes) {
+			release(base, size);
+			_trim(release);
+			return;
+		}
+
+		auto e = new (reinterpret_cast<void *>(base)) entry{.size = size, .since = _clock, .bin_hook = {}, .age_hook = {}};
+		_bins[bin_of(size)].push_front(e);
+		_by_age.push_back(e);
+		_bytes += size;
+		_trim(release);
+	}
+
+	// Passes all extents to release(base, size).
+	template<typename F>
+	void clear(F release) {
+		while(!_by_age.empty())
+			_release(_by_age.front(), release);
+	}
+
+	size_t bytes() {
+		return _bytes;
+	}
+
+	extent_cache_stats stats() {
+		return _stats;
+	}
+
+private:
+	void _remove(entry *e) {
+		_bins[bin_of(e->size)].erase(_bins[bin_of(e->size)].iterator_to(e));
+		_by_age.erase(_by_age.iterator_to(e));
+		_bytes -= e->size;
+	}
+
+	template<typename F>
+	void _release(entry *e, F &release) {
+		auto size = e->size;
+		_remove(e);
+		e->~entry();
+		release(reinterpret_cast<uintptr_t>(e), size);
+	}
+
+	// Evicts the oldest extents while the cache is too large or while they are too old.
+	template<typename F>
+	void _trim(F &release) {
+		while(!_by_age.empty()) {
+			auto e = _by_age.front();
+			if(_bytes <= MaxBytes && _clock - e->since < MaxAge)
+				break;
+			_release(e, release);
+		}
+	}
+
+	bin_list _bins[num_bins];
+	age_list _by_age;
+	size_t _bytes{0};
+	uint64_t _clock{0};
+	extent_cache_stats _stats{0, 0};
+};
+
+// Statistics of a single bucket, see pool_stats.
+struct bucket_stats {
+	size_t object_size{0};
+	uint64_t allocations{0};
+	uint64_t frees{0};
+	// Frees of objects that belong to a different pool (sharded_slab only).
+	uint64_t remote_frees{0};
+	// Number of slabs (or chunks) that are currently mapped.
+	uint64_t slabs_mapped{0};
+	// Bytes in objects that are currently allocated.
+	uint64_t bytes_live{0};
+	// Bytes of slabs (or chunks) that were ever handed out as objects.
+	// Since objects are carved lazily, this approximates the resident memory of the bucket.
+	uint64_t bytes_resident{0};
+};
+
+// Statistics of large objects, see pool_stats.
+struct large_stats {
+	uint64_t allocations{0};
+	uint64_t frees{0};
+	// Bytes that are currently allocated, in multiples of the page size.
+	// For sharded_slab, this includes the padding of each object's extent.
+	uint64_t bytes_live{0};
+};
+
+// Snapshot of the statistics of a pool, as returned by snapshot().
+// Objects can be freed by a different pool than the one that allocated them;
+// in this case, the values of a single pool can wrap around. Snapshots of multiple
+// pools can be summed up with operator+= to obtain the global values.
+template<size_t NumBuckets>
+struct pool_stats {
+	pool_stats &operator+= (const pool_stats &other) {
+		for(size_t i = 0; i < NumBuckets; i++) {
+			auto &b = buckets[i];
+			auto &ob = other.buckets[i];
+			b.allocations += ob.allocations;
+			b.frees += ob.frees;
+			b.remote_frees += ob.remote_frees;
+			b.slabs_mapped += ob.slabs_mapped;
+			b.bytes_live += ob.bytes_live;
+			b.bytes_resident += ob.bytes_resident;
+		}
+		large.allocations += other.large.allocations;
+		large.frees += other.large.frees;
+		large.bytes_live += other.large.bytes_live;
+		return *this;
+	}
+
+	bucket_stats buckets[NumBuckets];
+	large_stats large;
+};
+
+// Monotonic event counter that can be read concurrently to updates.
+// If SingleWriter is true, only a single thread updates the counter at a time,
+// so the counter can avoid atomic read-modify-write operations.
+template<bool SingleWriter>
+struct stats_counter {
+	void add(uint64_t n) {
+		if constexpr (SingleWriter) {
+			_value.store(_value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}else{
+			_value.fetch_add(n, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t load() const {
+		return _value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> _value{0};
+};
+
+// Counters that back pool_stats. Only the events are counted on the allocation paths;
+// the values of pool_stats are derived from them in snapshot().
+// The primary template is used if statistics are disabled and is empty.
+template<size_t NumBuckets, bool SingleWriter, bool Enabled>
+struct stats_counters { };
+
+template<size_t NumBuckets, bool SingleWriter>
+struct stats_counters<NumBuckets, SingleWriter, true> {
+	struct bucket_counters {
+		stats_counter<SingleWriter> allocations;
+		stats_counter<SingleWriter> frees;
+		stats_counter<SingleWriter> remote_frees;
+		// Bytes of allocated and freed objects (including remote frees).
+		// These are tracked separately from the number of objects since the objects
+		// of a bucket do not necessarily have the bucket's object_size.
+		stats_counter<SingleWriter> bytes_allocated;
+		stats_counter<SingleWriter> bytes_freed;
+		stats_counter<SingleWriter> slabs_mapped;
+		stats_counter<SingleWriter> slabs_unmapped;
+		stats_counter<SingleWriter> bytes_carved;
+		stats_counter<SingleWriter> bytes_released;
+	};
+
+	struct large_counters {
+		stats_counter<SingleWriter> allocations;
+		stats_counter<SingleWriter> frees;
+		stats_counter<SingleWriter> bytes_allocated;
+		stats_counter<SingleWriter> bytes_freed;
+	};
+
+	// Fills in all values of stats, except for object_size which must be filled in by the caller.
+	void snapshot(pool_stats<NumBuckets> &stats) const {
+		for(size_t i = 0; i < NumBuckets; i++) {
+			auto &b = stats.buckets[i];
+			auto &c = buckets[i];
+			// Decrements are loaded before increments, such that the
+			// derived values do not wrap around due to concurrent updates.
+			b.frees = c.frees.load();
+			b.remote_frees = c.remote_frees.load();
+			b.allocations = c.allocations.load();
+			auto freed = c.bytes_freed.load();
+			b.bytes_live = c.bytes_allocated.load() - freed;
+
+			auto unmapped = c.slabs_unmapped.load();
+			b.slabs_mapped = c.slabs_mapped.load() - unmapped;
+			auto released = c.bytes_released.load();
+			b.bytes_resident = c.bytes_carved.load() - released;
+		}
+		stats.large.frees = large.frees.load();
+		stats.large.allocations = large.allocations.load();
+		auto freed = large.bytes_freed.load();
+		stats.large.bytes_live = large.bytes_allocated.load() - freed;
+	}
+
+	bucket_counters buckets[NumBuckets];
+	large_counters large;
+};
+
 } // namespace slab
 
 namespace {
@@ -105,13 +690,25 @@ struct slab_policy_traits {
 	// small_step_exp controls how many buckets are between any two power-of-2 buckets.
 	// The first bucket has a size of size_t(1) << (small_base_exp + small_step_exp).
 	// This approach is taken from jemalloc.
+	// Policies can override small_step_exp, e.g., jemalloc uses small_step_exp = 2.
+	// small_base_exp is chosen such that the small buckets start at the last tiny bucket.
 #ifdef __clang__
 	static constexpr size_t tiny_sizes[4] = {8, 16, 32, 64};
 #else
 	static constexpr size_t tiny_sizes[] = {8, 16, 32, 64};
 #endif
-	static constexpr unsigned int small_base_exp = 6;
-	static constexpr unsigned int small_step_exp = 0;
+	static constexpr unsigned int small_step_exp = [] {
+		if constexpr (requires { Policy::small_step_exp; }) {
+			return Policy::small_step_exp;
+		}else{
+			return 0;
+		}
+	}();
+	// Larger values would space the buckets by 8 bytes, such that objects of
+	// the small buckets would not be aligned to 16 bytes (as required by malloc()).
+	static_assert(small_step_exp <= 2, "Buckets must be spaced by at least 16 bytes");
+
+	static constexpr unsigned int small_base_exp = 6 - small_step_exp;
 
 	static_assert(tiny_sizes[array_size(tiny_sizes) - 1]
 			== (static_cast<size_t>(1) << (small_base_exp + small_step_exp)),
@@ -132,8 +729,9 @@ struct slab_policy_traits {
 		return static_cast<size_t>(s + is) << f;
 	}
 
-	// The "inverse" of bucket_to_size().
-	static constexpr size_t size_to_bucket(size_t size) {
+	// Computes the inverse of bucket_to_size() using floor_log2().
+	// Used for sizes above lookup_max_size and to generate the lookup table.
+	static constexpr size_t compute_bucket(size_t size) {
 		// First, we handle the hard-coded tiny sizes.
 		auto tc = array_size(tiny_sizes);
 		if(size <= bucket_to_size(tc - 1)) {
@@ -152,15 +750,39 @@ struct slab_policy_traits {
 	}
 
 	// This variable controls the number of buckets that we actually use.
+	// By default, the largest bucket has a size of 32 KiB.
 	static constexpr int num_buckets = [](){
 		if constexpr (is_detected_v<policy_num_buckets_t, Policy>)
 			return Policy::num_buckets;
 		else
-			return 13;
+			return array_size(tiny_sizes) + (9 << small_step_exp);
 	}();
 
 	static constexpr size_t max_bucket_size = bucket_to_size(num_buckets - 1);
 
+	// Sizes up to lookup_max_size are mapped to buckets by a table with 8 byte granularity.
+	static constexpr size_t lookup_max_size = max_bucket_size < 4096 ? max_bucket_size : 4096;
+
+	static_assert(num_buckets <= 256, "Bucket indices must fit into the lookup table");
+
+	struct lookup_table {
+		uint8_t buckets[(lookup_max_size + 7) / 8 + 1];
+	};
+
+	static constexpr lookup_table lookup = [] {
+		lookup_table table{};
+		for(size_t i = 0; i < array_size(table.buckets); i++)
+			table.buckets[i] = compute_bucket(i * 8);
+		return table;
+	}();
+
+	// The "inverse" of bucket_to_size().
+	static constexpr size_t size_to_bucket(size_t size) {
+		if(size <= lookup_max_size)
+			return lookup.buckets[(size + 7) >> 3];
+		return compute_bucket(size);
+	}
+
 	// Here, we perform some compile-time verification of the bucket size calculation.
 	static constexpr bool test_bucket_calculation(unsigned int n) {
 		for(unsigned int i = 0; i < n; i++) {
@@ -168,6 +790,8 @@ struct slab_policy_traits {
 				return false;
 			if(size_to_bucket(bucket_to_size(i) + 1) != i + 1)
 				return false;
+			if(i && size_to_bucket(bucket_to_size(i - 1) + 1) != i)
+				return false;
 		}
 		return true;
 	}
@@ -186,15 +810,51 @@ public:
 	slab_pool &operator= (const slab_pool &) = delete;
 
 	void *allocate(size_t length);
+	// Allocates memory that is aligned to alignment, which must be a power of two.
+	// Alignments up to the superblock size are supported.
+	// The returned pointer can be passed to free(), deallocate(), realloc() and get_size().
+	void *allocate_aligned(size_t length, size_t alignment);
 	void *realloc(void *pointer, size_t new_length);
 	void free(void *pointer);
 	void deallocate(void *pointer, size_t size);
+	// If the page map is enabled, get_size() returns zero for pointers that were
+	// not allocated from this pool.
 	size_t get_size(void *pointer);
 
+	// Returns true if the pointer points to an object of this pool, i.e., to the start of
+	// a large object or of a slot in one of the pool's slabs. Objects that are freed
+	// are only detected once their slab or large extent is released.
+	// This only reads the page map and does not take any locks.
+	// Only available if Policy::enable_page_map is true.
+	bool owns(void *pointer) requires (Policy::enable_page_map) {
+		return pointer && _find_frame(pointer);
+	}
+
+	// Returns all objects cached in magazines to their slabs and
+	// releases all empty slabs and large extents that are cached by the pool.
+	void purge();
+
 	size_t numUsedPages() {
 		return _usedPages;
 	}
 
+	slab::extent_cache_stats large_cache_stats() {
+		unique_lock<Mutex> tree_guard(_tree_mutex);
+		return _large_cache.stats();
+	}
+
+	using stats_type = slab::pool_stats<slab_policy_traits<Policy>::num_buckets>;
+
+	// Returns the current statistics. Only available if Policy::enable_stats is true.
+	// This does not take any locks and can be called concurrently to allocations.
+	stats_type snapshot() requires (Policy::enable_stats) {
+		stats_type stats;
+		for(size_t i = 0; i < policy_traits::num_buckets; i++)
+			stats.buckets[i].object_size = policy_traits::bucket_to_size(i);
+		_stats.snapshot(stats);
+		return stats;
+	}
+
 private:
 	using policy_traits = slab_policy_traits<Policy>;
 
@@ -223,6 +883,113 @@ private:
 
 	static_assert(sb_size >= slabsize);
 
+	// Upper bound on the size of the extents of freed large objects that are cached for reuse.
+	static constexpr size_t large_cache_bytes = [] {
+		if constexpr (requires { Policy::large_cache_bytes; }) {
+			return Policy::large_cache_bytes;
+		}else{
+			return size_t{1} << 22;
+		}
+	}();
+
+	// Cached extents are released once they were not reused for this many
+	// large allocations or frees.
+	static constexpr uint64_t large_cache_decay = [] {
+		if constexpr (requires { Policy::large_cache_decay; }) {
+			return Policy::large_cache_decay;
+		}else{
+			return 256;
+		}
+	}();
+
+	// Statistics are only maintained if the Policy asks for them, see snapshot().
+	static constexpr bool enable_stats = [] {
+		if constexpr (requires { Policy::enable_stats; }) {
+			return Policy::enable_stats;
+		}else{
+			return false;
+		}
+	}();
+
+	// Number of empty slabs that each bucket caches before it returns them to the Policy.
+	static constexpr size_t max_empty_slabs = [] {
+		if constexpr (requires { Policy::max_empty_slabs; }) {
+			return Policy::max_empty_slabs;
+		}else{
+			return 1;
+		}
+	}();
+
+	// Per-CPU magazines are only used if the Policy provides cpu_index().
+	static constexpr bool enable_magazines = slab::has_cpu_support<Policy>;
+
+	static constexpr size_t max_cpus = [] {
+		if constexpr (enable_magazines) {
+			return Policy::max_cpus;
+		}else{
+			return 0;
+		}
+	}();
+
+	// Number of objects in each magazine.
+	static constexpr size_t magazine_size = [] {
+		if constexpr (requires { Policy::magazine_size; }) {
+			return Policy::magazine_size;
+		}else{
+			return 16;
+		}
+	}();
+
+	// Number of empty magazines that each depot keeps before they are freed.
+	static constexpr size_t max_empty_magazines = 4;
+
+	// Buckets only take the bucket_mutex for slab state transitions if the Policy asks
+	// for lock-free buckets, see _allocate_lock_free(). This is not worth it on single-CPU
+	// systems, and it cannot be combined with poisoning (allocations read the freelist
+	// links of objects that other threads might have allocated concurrently).
+	static constexpr bool lock_free_buckets = [] {
+		if constexpr (requires { Policy::lock_free_buckets; }) {
+			return Policy::lock_free_buckets;
+		}else{
+			return false;
+		}
+	}();
+
+	static_assert(!lock_free_buckets || !slab::has_poisoning_support<Policy>,
+			"Lock-free buckets do not support poisoning");
+
+	// Number of objects that the active slab of a lock-free bucket hands out
+	// before the bucket_mutex is taken to reserve more objects.
+	// Credits are stored in the low bits of the (sb_size aligned) slab address.
+	static constexpr size_t max_credits = 63;
+
+	// The page map maps superblocks to their frames. It allows the pool to check whether
+	// pointers belong to it, see owns(). Lookups do not take any locks.
+	static constexpr bool enable_page_map = [] {
+		if constexpr (requires { Policy::enable_page_map; }) {
+			return Policy::enable_page_map;
+		}else{
+			return false;
+		}
+	}();
+
+	// Number of significant bits of addresses that are returned by Policy::map().
+	static constexpr int address_bits = [] {
+		if constexpr (requires { Policy::address_bits; }) {
+			return Policy::address_bits;
+		}else{
+			return 48;
+		}
+	}();
+
+	// The page map is a two-level radix tree indexed by superblock number.
+	// The root is part of the pool while the leaves are mapped on demand.
+	static constexpr int sb_shift = floor_log2(sb_size);
+	static constexpr int page_map_bits = address_bits - sb_shift;
+	static constexpr int page_map_root_bits = page_map_bits < 12 ? page_map_bits : 12;
+	static constexpr int page_map_leaf_bits = page_map_bits - page_map_root_bits;
+
+	static_assert(is_p2(sb_size), "Superblock size must be a power of two");
 	static_assert(!(sb_size & (page_size - 1)),
 			"Superblock size must be a multiple of the page size");
 	static_assert(!(slabsize & (page_size - 1)),
@@ -274,26 +1041,102 @@ private:
 		size_t sb_reservation;
 
 		const uintptr_t address;
-		const size_t length;
+		// Can change for large frames, see reallocate_huge_() and remap_huge_().
+		size_t length;
 #ifdef FRG_SLAB_TRACK_REGIONS
 		rbtree_hook frame_hook;
 #endif
 	};
 	static_assert(sizeof(frame) <= huge_padding, "Padding too small");
 
+	//--------------------------------------------------------------------------------------
+	// Lock-free buckets.
+	// This follows Michael, "Scalable Lock-Free Dynamic Memory Allocation". Each slab has an
+	// anchor that packs the head of its freelist, the number of reserved objects, the state
+	// of the slab and an ABA tag into a single word. Each bucket has an active word that
+	// holds the active slab and a number of credits, i.e., objects on the freelist of the
+	// active slab that are reserved for allocations. Allocations take a credit and pop an
+	// object from the freelist. Frees push the object, unless the slab becomes empty or
+	// stops being full. Since credits count as reserved objects, a slab cannot become
+	// empty (and be released) while a credit for it is outstanding.
+	//--------------------------------------------------------------------------------------
+
+	enum class slab_state : uint64_t {
+		// The slab is the head_slb of its bucket. Active slabs are never released.
+		active,
+		// The slab is in the partial_tree of its bucket.
+		partial,
+		// The slab has no free objects that are not reserved.
+		full,
+		// The slab has no reserved objects and is cached in empty_slb (or released).
+		empty
+	};
+
+	struct slab_anchor {
+		// Objects are stored as offset from the slab header in units of 8 bytes,
+		// such that zero means that the freelist is empty.
+		static constexpr int avail_bits = ceil_log2(slabsize) - 3;
+		static constexpr int reserved_bits = avail_bits + 1;
+		static constexpr int state_bits = 2;
+		static constexpr int tag_bits = 64 - avail_bits - reserved_bits - state_bits;
+
+		static constexpr uint64_t mask(int bits) {
+			return (uint64_t{1} << bits) - 1;
+		}
+
+		static slab_anchor unpack(uint64_t word) {
+			return {
+				.avail = word & mask(avail_bits),
+				.reserved = (word >> avail_bits) & mask(reserved_bits),
+				.state = static_cast<slab_state>((word >> (avail_bits + reserved_bits))
+						& mask(state_bits)),
+				.tag = word >> (avail_bits + reserved_bits + state_bits)
+			};
+		}
+
+		// The tag wraps around.
+		uint64_t pack() const {
+			return avail | (reserved << avail_bits)
+					| (static_cast<uint64_t>(state) << (avail_bits + reserved_bits))
+					| (tag << (avail_bits + reserved_bits + state_bits));
+		}
+
+		uint64_t avail;
+		uint64_t reserved;
+		slab_state state;
+		uint64_t tag;
+	};
+
+	static_assert(!lock_free_buckets || slab_anchor::tag_bits >= 24,
+			"Slabs are too large for lock-free buckets");
+
 	struct slab_frame : frame {
 		slab_frame(uintptr_t address_, size_t length_, int index_)
 		: frame{frame_type::slab, address_, length_},
-				index{index_}, num_reserved{0}, available{nullptr} { }
+				index{index_}, num_reserved{0}, available{nullptr},
+				carve{address_}, next_empty{nullptr}, anchor{0} { }
 
 		slab_frame(const slab_frame &) = delete;
 
 		slab_frame &operator= (const slab_frame &) = delete;
 
 		const int index;
+		// Number of live objects in this slab.
 		unsigned int num_reserved;
 		freelist *available;
+		// Objects at or above this address were never allocated and are not on any freelist.
+		// They are carved off lazily once available is exhausted.
+		uintptr_t carve;
 		rbtree_hook partial_hook;
+		// Next slab in bucket::empty_slb.
+		slab_frame *next_empty;
+		// Replaces available and num_reserved in lock-free buckets, see slab_anchor.
+		// New slabs start out as active slabs without reserved objects.
+		std::atomic<uint64_t> anchor;
+
+		bool has_free() {
+			return available || carve < this->address + this->length;
+		}
 	};
 
 	struct frame_less {
@@ -318,13 +1161,56 @@ private:
 
 	// Like in jemalloc, we always allocate a slab completely (the head_slb) before
 	// moving to the next slab. This reduces external fragmentation.
+	// Slabs without live objects are removed from the partial_tree and cached
+	// in empty_slb until they are either reused or released.
 	struct bucket {
 		bucket()
-		: head_slb{nullptr} { }
+		: head_slb{nullptr}, empty_slb{nullptr}, num_empty{0}, active{0} { }
 
 		Mutex bucket_mutex;
 		slab_frame *head_slb;
 		partial_tree_type partial_tree;
+		slab_frame *empty_slb;
+		size_t num_empty;
+		// Only used by lock-free buckets: head_slb and its credits (or zero).
+		// Credits are only added with the bucket_mutex held.
+		std::atomic<uintptr_t> active;
+	};
+
+	//--------------------------------------------------------------------------------------
+	// Magazine layer.
+	// This follows Bonwick and Adams, "Magazines and Vmem". Each CPU owns a loaded and a
+	// previous magazine per bucket, such that most allocations and frees do not touch the
+	// bucket at all. Full and empty magazines are exchanged with the depot of the bucket,
+	// which is protected by the bucket_mutex.
+	//--------------------------------------------------------------------------------------
+
+	struct magazine {
+		magazine *next;
+		size_t rounds;
+		void *objects[magazine_size];
+	};
+
+	// The previous magazine is always either full or empty.
+	struct cpu_magazines {
+		Mutex mutex;
+		magazine *loaded{nullptr};
+		magazine *previous{nullptr};
+	};
+
+	struct magazine_depot {
+		magazine *full{nullptr};
+		magazine *empty{nullptr};
+		size_t num_empty{0};
+	};
+
+	template<bool Enabled, typename = void>
+	struct magazine_layer { };
+
+	template<typename D>
+	struct magazine_layer<true, D> {
+		cpu_magazines cpus[max_cpus][policy_traits::num_buckets];
+		magazine_depot depots[policy_traits::num_buckets];
 	};
 
 private:
@@ -332,7 +1218,48 @@ private:
 	// Slab handling.
 	//--------------------------------------------------------------------------------------
 
+	void *_allocate_small(int index, size_t length);
+	freelist *_allocate_from_slab(int index);
+	// Constructs a slab and adds it to the accounting of the pool.
+	slab_frame *_new_slab(int index);
 	slab_frame *_construct_slab(int index);
+	void _release_slab(slab_frame *slb);
+
+	freelist *_allocate_lock_free(int index);
+	// Returns the active slab after taking a credit for it, or nullptr if no slab could be created.
+	// Must be called with the bucket lock held; the lock is dropped to create new slabs.
+	slab_frame *_refill_credits(int index, unique_lock<Mutex> &bucket_guard);
+
+	// Calls f with the statistics counters if statistics are enabled.
+	template<typename F>
+	void _count(F f) {
+		if constexpr (enable_stats)
+			f(_stats);
+	}
+
+	// Take a free object from a slab. Recycled objects are preferred over carving new ones.
+	// Must be called with the bucket lock held (or on slabs that are not visible to other threads).
+	freelist *pop_from_slab_(slab_frame *slb) {
+		freelist *object;
+		if(slb->available) {
+			object = slb->available;
+			FRG_ASSERT(slb->contains(object));
+			if(object->link && !slb->contains(object->link))
+				FRG_ASSERT(!"slab_pool corruption. Possible write to unallocated object");
+			slb->available = object->link;
+		}else{
+			FRG_ASSERT(slb->carve < slb->address + slb->length);
+			if constexpr (slab::has_poisoning_support<Policy>)
+				_plcy.unpoison(reinterpret_cast<void *>(slb->carve), sizeof(freelist));
+			object = new (reinterpret_cast<void *>(slb->carve)) freelist;
+			slb->carve += policy_traits::bucket_to_size(slb->index);
+			_count([&] (auto &stats) {
+				stats.buckets[slb->index].bytes_carved.add(policy_traits::bucket_to_size(slb->index));
+			});
+		}
+		slb->num_reserved++;
+		return object;
+	}
 
 	bool reallocate_in_slab_(slab_frame *slb, void *p, size_t new_size) {
 		size_t item_size = policy_traits::bucket_to_size(slb->index);
@@ -356,25 +1283,69 @@ private:
 		FRG_ASSERT(slb->contains(p));
 		FRG_ASSERT(!enable_checking
 				|| !((reinterpret_cast<uintptr_t>(p) - slb->address) % item_size));
+		_count([&] (auto &stats) {
+			stats.buckets[slb->index].frees.add(1);
+			stats.buckets[slb->index].bytes_freed.add(item_size);
+		});
 
-		if constexpr (slab::has_poisoning_support<Policy>) {
-			_plcy.unpoison_expand(p, item_size);
-			_plcy.poison(p, item_size);
-			_plcy.unpoison(p, sizeof(freelist));
+		if constexpr (enable_magazines) {
+			// Poison before the object becomes visible to other CPUs.
+			if constexpr (slab::has_poisoning_support<Policy>) {
+				_plcy.unpoison_expand(p, item_size);
+				_plcy.poison(p, item_size);
+			}
+			if(_magazine_free(slb->index, p))
+				return;
+		}
+
+		free_to_slab_(slb, p);
+	}
+
+	// Returns an object to its slab, bypassing the magazine layer.
+	void free_to_slab_(slab_frame *slb, void *p) {
+		size_t item_size = policy_traits::bucket_to_size(slb->index);
+
+		if constexpr (slab::has_poisoning_support<Policy>) {
+			_plcy.unpoison_expand(p, item_size);
+			_plcy.poison(p, item_size);
+			_plcy.unpoison(p, sizeof(freelist));
 		}
 		auto object = new (p) freelist;
 
+		if constexpr (lock_free_buckets) {
+			free_lock_free_(slb, object);
+			return;
+		}
+
 		auto bkt = &_bkts[slb->index];
 		unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
 		{
-			bool reinsert_into_bucket = !slb->available;
+			bool reinsert_into_bucket = !slb->has_free();
 			FRG_ASSERT(slb->num_reserved);
 
 			FRG_ASSERT(!slb->available || slb->contains(slb->available));
 			object->link = slb->available;
 			slb->available = object;
-
-			if(reinsert_into_bucket) {
+			slb->num_reserved--;
+
+			if(!slb->num_reserved) {
+				// The slab is empty. Move it from the partial_tree to the cache of empty slabs.
+				if(!reinsert_into_bucket) {
+					bkt->partial_tree.remove(slb);
+					if(bkt->head_slb == slb)
+						bkt->head_slb = bkt->partial_tree.first();
+				}
+
+				if(bkt->num_empty < max_empty_slabs) {
+					slb->next_empty = bkt->empty_slb;
+					bkt->empty_slb = slb;
+					bkt->num_empty++;
+				}else{
+					// Call into the Policy without holding locks.
+					bucket_guard.unlock();
+					_release_slab(slb);
+				}
+			}else if(reinsert_into_bucket) {
 				bkt->partial_tree.insert(slb);
 				if(!bkt->head_slb || slb->address < bkt->head_slb->address)
 					bkt->head_slb = slb;
@@ -382,17 +1353,254 @@ private:
 		}
 	}
 
+	static freelist *anchor_object_(slab_frame *slb, uint64_t avail) {
+		if(!avail)
+			return nullptr;
+		return reinterpret_cast<freelist *>(reinterpret_cast<uintptr_t>(slb) + (avail << 3));
+	}
+
+	static uint64_t anchor_avail_(slab_frame *slb, freelist *object) {
+		if(!object)
+			return 0;
+		return (reinterpret_cast<uintptr_t>(object) - reinterpret_cast<uintptr_t>(slb)) >> 3;
+	}
+
+	// Links of objects on lock-free freelists are accessed atomically since threads that
+	// pop objects might read the links of objects that were taken by other threads.
+	static freelist *load_link_(freelist *object) {
+		return std::atomic_ref<freelist *>{object->link}.load(std::memory_order_relaxed);
+	}
+
+	static void store_link_(freelist *object, freelist *link) {
+		std::atomic_ref<freelist *>{object->link}.store(link, std::memory_order_relaxed);
+	}
+
+	// Pops an object from the freelist of a slab. The caller must own a credit for the slab.
+	freelist *pop_reserved_(slab_frame *slb) {
+		auto word = slb->anchor.load(std::memory_order_acquire);
+		while(true) {
+			auto a = slab_anchor::unpack(word);
+			auto object = anchor_object_(slb, a.avail);
+			FRG_ASSERT(object);
+			// If another thread takes the object concurrently, the tag changes and the CAS fails.
+			a.avail = anchor_avail_(slb, load_link_(object));
+			a.tag++;
+			if(slb->anchor.compare_exchange_weak(word, a.pack(),
+					std::memory_order_acquire, std::memory_order_acquire))
+				return object;
+		}
+	}
+
+	// Changes the state of a slab. Must be called with the bucket lock held.
+	void set_state_(slab_frame *slb, slab_state from, slab_state to) {
+		auto word = slb->anchor.load(std::memory_order_relaxed);
+		while(true) {
+			auto a = slab_anchor::unpack(word);
+			FRG_ASSERT(a.state == from);
+			a.state = to;
+			a.tag++;
+			if(slb->anchor.compare_exchange_weak(word, a.pack(),
+					std::memory_order_relaxed, std::memory_order_relaxed))
+				return;
+		}
+	}
+
+	// Carves up to max_credits objects off the slab and pushes them onto its freelist.
+	// Must be called with the bucket lock held. Returns the number of carved objects.
+	size_t carve_objects_(slab_frame *slb) {
+		size_t item_size = policy_traits::bucket_to_size(slb->index);
+		freelist *first = nullptr;
+		freelist *last = nullptr;
+		size_t n = 0;
+		while(n < max_credits && slb->carve < slb->address + slb->length) {
+			auto object = new (reinterpret_cast<void *>(slb->carve)) freelist;
+			if(last) {
+				last->link = object;
+			}else{
+				first = object;
+			}
+			last = object;
+			slb->carve += item_size;
+			n++;
+		}
+		if(!n)
+			return 0;
+		_count([&] (auto &stats) { stats.buckets[slb->index].bytes_carved.add(n * item_size); });
+
+		auto word = slb->anchor.load(std::memory_order_relaxed);
+		while(true) {
+			auto a = slab_anchor::unpack(word);
+			store_link_(last, anchor_object_(slb, a.avail));
+			a.avail = anchor_avail_(slb, first);
+			a.tag++;
+			if(slb->anchor.compare_exchange_weak(word, a.pack(),
+					std::memory_order_release, std::memory_order_relaxed))
+				return n;
+		}
+	}
+
+	// Reserves up to max_credits free objects of the slab, carving new objects if necessary.
+	// If the slab has no free objects left, it becomes full and zero is returned.
+	// Must be called with the bucket lock held.
+	size_t reserve_objects_(slab_frame *slb) {
+		size_t item_size = policy_traits::bucket_to_size(slb->index);
+		auto word = slb->anchor.load(std::memory_order_relaxed);
+		while(true) {
+			auto a = slab_anchor::unpack(word);
+			FRG_ASSERT(a.state == slab_state::active);
+			size_t carved = (slb->carve - slb->address) / item_size;
+			FRG_ASSERT(a.reserved <= carved);
+
+			if(size_t free = carved - a.reserved; free) {
+				size_t n = free < max_credits ? free : max_credits;
+				a.reserved += n;
+				a.tag++;
+				if(slb->anchor.compare_exchange_weak(word, a.pack(),
+						std::memory_order_relaxed, std::memory_order_relaxed))
+					return n;
+				continue;
+			}
+
+			if(carve_objects_(slb)) {
+				word = slb->anchor.load(std::memory_order_relaxed);
+				continue;
+			}
+
+			// Frees that race with this CAS see the full state and take the bucket lock.
+			a.state = slab_state::full;
+			a.tag++;
+			if(slb->anchor.compare_exchange_weak(word, a.pack(),
+					std::memory_order_relaxed, std::memory_order_relaxed))
+				return 0;
+		}
+	}
+
+	// Frees that do not change the state of the slab only push the object to the freelist.
+	void free_lock_free_(slab_frame *slb, freelist *object) {
+		auto avail = anchor_avail_(slb, object);
+		auto word = slb->anchor.load(std::memory_order_relaxed);
+		while(true) {
+			auto a = slab_anchor::unpack(word);
+			FRG_ASSERT(a.reserved);
+			if(a.state == slab_state::full || (a.state == slab_state::partial && a.reserved == 1))
+				break;
+			store_link_(object, anchor_object_(slb, a.avail));
+			a.avail = avail;
+			a.reserved--;
+			a.tag++;
+			if(slb->anchor.compare_exchange_weak(word, a.pack(),
+					std::memory_order_release, std::memory_order_relaxed))
+				return;
+		}
+
+		auto bkt = &_bkts[slb->index];
+		unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+		word = slb->anchor.load(std::memory_order_relaxed);
+		slab_state from;
+		slab_anchor a;
+		do {
+			a = slab_anchor::unpack(word);
+			FRG_ASSERT(a.reserved);
+			from = a.state;
+			store_link_(object, anchor_object_(slb, a.avail));
+			a.avail = avail;
+			a.reserved--;
+			a.tag++;
+			if(from != slab_state::active)
+				a.state = a.reserved ? slab_state::partial : slab_state::empty;
+		} while(!slb->anchor.compare_exchange_weak(word, a.pack(),
+				std::memory_order_release, std::memory_order_relaxed));
+
+		if(a.state == slab_state::partial && from == slab_state::full) {
+			bkt->partial_tree.insert(slb);
+		}else if(a.state == slab_state::empty) {
+			if(from == slab_state::partial)
+				bkt->partial_tree.remove(slb);
+
+			if(bkt->num_empty < max_empty_slabs) {
+				slb->next_empty = bkt->empty_slb;
+				bkt->empty_slb = slb;
+				bkt->num_empty++;
+			}else{
+				// Call into the Policy without holding locks.
+				bucket_guard.unlock();
+				_release_slab(slb);
+			}
+		}
+	}
+
+	// Returns the unused credits of the active slab of a bucket. If the slab has no reserved
+	// objects left, it is moved to the cached empty slabs. Must be called with the bucket lock held.
+	void deactivate_slab_(bucket *bkt) {
+		auto slb = bkt->head_slb;
+		if(!slb)
+			return;
+		auto credits = bkt->active.exchange(0, std::memory_order_relaxed) & max_credits;
+
+		auto word = slb->anchor.load(std::memory_order_relaxed);
+		slab_anchor a;
+		do {
+			a = slab_anchor::unpack(word);
+			FRG_ASSERT(a.state == slab_state::active);
+			FRG_ASSERT(a.reserved >= credits);
+			a.reserved -= credits;
+			a.tag++;
+			if(!a.reserved)
+				a.state = slab_state::empty;
+		} while(!slb->anchor.compare_exchange_weak(word, a.pack(),
+				std::memory_order_relaxed, std::memory_order_relaxed));
+
+		if(a.state == slab_state::empty) {
+			bkt->head_slb = nullptr;
+			slb->next_empty = bkt->empty_slb;
+			bkt->empty_slb = slb;
+			bkt->num_empty++;
+		}
+	}
+
+	// Returns nullptr if neither the CPU's magazines nor the depot have objects.
+	void *_magazine_allocate(int index);
+	// Returns false if no empty magazine could be obtained.
+	bool _magazine_free(int index, void *p);
+	magazine *_allocate_magazine();
+	// Returns all rounds of the magazine to their slabs and frees the magazine.
+	void _destroy_magazine(magazine *mag);
+
+	cpu_magazines &_cpu_magazines(int index) {
+		size_t cpu = _plcy.cpu_index();
+		FRG_ASSERT(cpu < max_cpus);
+		return _magazines.cpus[cpu][index];
+	}
+
 	//--------------------------------------------------------------------------------------
 	// Huge superblock handling.
 	//--------------------------------------------------------------------------------------
 
-	frame *_construct_large(size_t area_size);
+	void *_allocate_large(size_t length, size_t alignment);
+	frame *_construct_large(size_t area_size, size_t padding);
+
+	// Number of pages that are accounted to a large frame.
+	static size_t _large_pages(frame *fra) {
+		return (fra->address + fra->length - reinterpret_cast<uintptr_t>(fra)) / page_size;
+	}
 
 	bool reallocate_huge_(frame *sup, void *p, size_t new_size) {
 		FRG_ASSERT(sup->address == reinterpret_cast<uintptr_t>(p));
 
-		if(new_size > sup->length)
-			return false;
+		if(new_size > sup->length) {
+			// Grow into the part of the reservation that is not used yet.
+			// Extents that are taken from the large object cache often have such slack.
+			auto new_length = (new_size + page_size - 1) & ~(page_size - 1);
+			if(sup->address + new_length > sup->sb_base + sup->sb_reservation)
+				return false;
+
+			_count([&] (auto &stats) { stats.large.bytes_allocated.add(new_length - sup->length); });
+
+			unique_lock<Mutex> tree_guard(_tree_mutex);
+			_usedPages -= _large_pages(sup);
+			sup->length = new_length;
+			_usedPages += _large_pages(sup);
+		}
 
 		if constexpr (slab::has_poisoning_support<Policy>) {
 			_plcy.unpoison_expand(p, sup->length);
@@ -402,29 +1610,328 @@ private:
 		return true;
 	}
 
-	void free_huge_(frame *sup, void *p) {
+	// Resizes the mapping of a large frame using Policy::remap().
+	// If the mapping moves, the frame is re-aligned to sb_size within the new mapping.
+	// Returns nullptr if the frame was not remapped.
+	void *remap_huge_(frame *sup, void *p, size_t new_size) {
 		FRG_ASSERT(sup->address == reinterpret_cast<uintptr_t>(p));
 
-		// Remove the virtual area from the area-list.
-		{
-			unique_lock<Mutex> tree_guard(_tree_mutex);
+		auto sb_base = sup->sb_base;
+		auto sb_reservation = sup->sb_reservation;
+		auto header_offset = reinterpret_cast<uintptr_t>(sup) - sb_base;
+		auto padding = sup->address - reinterpret_cast<uintptr_t>(sup);
+		auto length = sup->length;
+		auto new_length = (new_size + page_size - 1) & ~(page_size - 1);
+
+		// Reserve sb_size bytes of slack such that the frame can be re-aligned.
+		auto new_reservation = sb_size + padding + new_length;
+		if(new_length > length) {
+			// reallocate_huge_() handles growth into the existing reservation.
+			if(sup->address + new_length <= sb_base + sb_reservation)
+				return nullptr;
+		}else{
+			// Only shrink the mapping if that releases at least half of it.
+			if(2 * new_reservation > sb_reservation)
+				return nullptr;
+		}
+
+		// Extending the page map cannot fail once the object was moved,
+		// hence we take a spare leaf before remapping.
+		frame **spare_leaf = nullptr;
+		if constexpr (enable_page_map) {
+			spare_leaf = _take_spare_leaf();
+			if(!spare_leaf)
+				return nullptr;
+		}
+
+		// The frame header moves with the mapping, so it cannot stay in the tree.
+		_remove_frame(sup);
+		unique_lock<Mutex> tree_guard(_tree_mutex);
+#ifdef FRG_SLAB_TRACK_REGIONS
+		_frame_tree.remove(sup);
+#endif
+		_usedPages -= _large_pages(sup);
+		tree_guard.unlock();
 
+		uintptr_t new_base = _plcy.remap(sb_base, sb_reservation, new_reservation);
+		if(!new_base) {
+			// The leaf of the page map still exists, so this cannot fail.
+			_insert_frame(sup);
+			_put_spare_leaf(spare_leaf);
+			tree_guard.lock();
 #ifdef FRG_SLAB_TRACK_REGIONS
-			_frame_tree.remove(sup);
+			_frame_tree.insert(sup);
 #endif
-			_usedPages -= (sup->length + huge_padding) / page_size;
+			_usedPages += _large_pages(sup);
+			return nullptr;
+		}
+
+		if constexpr (slab::has_poisoning_support<Policy>) {
+			_plcy.poison(sup, sizeof(frame));
+			_plcy.poison(p, length);
+			_plcy.unpoison_expand(reinterpret_cast<void *>(new_base), new_reservation);
+		}
+
+		// The object only needs to be moved if the mapping moved to an address
+		// that is aligned differently (relative to sb_size) than the old one.
+		auto address = (new_base + sb_size - 1) & ~(sb_size - 1);
+		if(address != new_base + header_offset)
+			memmove(reinterpret_cast<void *>(address + padding),
+					reinterpret_cast<void *>(new_base + header_offset + padding),
+					length < new_length ? length : new_length);
+		FRG_ASSERT(address + padding + new_length <= new_base + new_reservation);
+
+		auto fra = new ((void *)address) frame(frame_type::large,
+				address + padding, new_length);
+		fra->sb_base = new_base;
+		fra->sb_reservation = new_reservation;
+		_count([&] (auto &stats) {
+			if(new_length > length) {
+				stats.large.bytes_allocated.add(new_length - length);
+			}else{
+				stats.large.bytes_freed.add(length - new_length);
+			}
+		});
+
+		if constexpr (slab::has_poisoning_support<Policy>) {
+			_plcy.poison(reinterpret_cast<void *>(new_base), new_reservation);
+			_plcy.unpoison(fra, sizeof(frame));
+			_plcy.unpoison(reinterpret_cast<void *>(fra->address), new_size);
 		}
 
+		bool inserted = _insert_frame(fra, spare_leaf);
+		FRG_ASSERT(inserted);
+		_put_spare_leaf(spare_leaf);
+		tree_guard.lock();
+#ifdef FRG_SLAB_TRACK_REGIONS
+		_frame_tree.insert(fra);
+#endif
+		_usedPages += _large_pages(fra);
+		return reinterpret_cast<void *>(fra->address);
+	}
+
+	void free_huge_(frame *sup, void *p) {
+		FRG_ASSERT(sup->address == reinterpret_cast<uintptr_t>(p));
+
 		// Note: we cannot access sup after poison().
 		auto sb_base = sup->sb_base;
 		auto sb_reservation = sup->sb_reservation;
 		auto obj_address = sup->address;
 		auto obj_size = sup->length;
+		auto pages = _large_pages(sup);
+		_remove_frame(sup);
+
+		// Remove the virtual area from the area-list.
+		unique_lock<Mutex> tree_guard(_tree_mutex);
+#ifdef FRG_SLAB_TRACK_REGIONS
+		_frame_tree.remove(sup);
+#endif
+		_usedPages -= pages;
+		tree_guard.unlock();
+		_count([&] (auto &stats) {
+			stats.large.frees.add(1);
+			stats.large.bytes_freed.add(obj_size);
+		});
+
 		if constexpr (slab::has_poisoning_support<Policy>) {
 			_plcy.poison(sup, sizeof(frame));
 			_plcy.poison(reinterpret_cast<void *>(obj_address), obj_size);
+			_plcy.unpoison(reinterpret_cast<void *>(sb_base), large_cache_type::entry_size);
+		}
+
+		// Cached extents must be aligned to sb_size if the Policy supports aligned mappings
+		// (see _construct_large()). This is not true for extents that were moved by remap_huge_().
+		if constexpr (is_detected_v<policy_map_aligned_t, Policy>) {
+			if(sb_base & (sb_size - 1)) {
+				if constexpr (slab::has_poisoning_support<Policy>)
+					_plcy.poison(reinterpret_cast<void *>(sb_base), large_cache_type::entry_size);
+				_plcy.unmap(sb_base, sb_reservation);
+				return;
+			}
+		}
+
+		// Move the extent into the cache. Extents that are evicted from the cache
+		// are chained through their first bytes and unmapped without holding locks.
+		uintptr_t evicted = 0;
+		tree_guard.lock();
+		_large_cache.put(sb_base, sb_reservation, [&] (uintptr_t base, size_t size) {
+			new (reinterpret_cast<void *>(base)) evicted_extent{evicted, size};
+			evicted = base;
+		});
+		tree_guard.unlock();
+
+		_unmap_evicted(evicted);
+	}
+
+	struct evicted_extent {
+		uintptr_t next;
+		size_t size;
+	};
+
+	void _unmap_evicted(uintptr_t evicted) {
+		while(evicted) {
+			auto ee = reinterpret_cast<evicted_extent *>(evicted);
+			auto next = ee->next;
+			auto size = ee->size;
+			if constexpr (slab::has_poisoning_support<Policy>)
+				_plcy.poison(ee, large_cache_type::entry_size);
+			_plcy.unmap(evicted, size);
+			evicted = next;
+		}
+	}
+
+	//--------------------------------------------------------------------------------------
+	// Page map.
+	//--------------------------------------------------------------------------------------
+
+	static constexpr size_t page_map_leaf_size = (size_t{1} << page_map_leaf_bits) * sizeof(frame *);
+
+	struct page_map {
+		frame **leaves[size_t{1} << page_map_root_bits]{};
+		// A leaf that was mapped ahead of time, see _take_spare_leaf().
+		frame **spare_leaf{nullptr};
+	};
+
+	struct no_page_map { };
+
+	// Maps a leaf of the page map. Returns nullptr on failure.
+	frame **_map_page_map_leaf() {
+		// Leaves are zero-initialized by Policy::map().
+		uintptr_t leaf_address;
+		if constexpr (is_detected_v<policy_map_aligned_t, Policy>) {
+			leaf_address = _plcy.map(page_map_leaf_size, page_size);
+		}else{
+			leaf_address = _plcy.map(page_map_leaf_size);
+		}
+		return reinterpret_cast<frame **>(leaf_address);
+	}
+
+	// Returns a leaf that can be passed to _page_map_slot(), such that extending the
+	// page map cannot fail. Returns nullptr if no leaf could be mapped.
+	frame **_take_spare_leaf() {
+		std::atomic_ref<frame **> spare{_page_map.spare_leaf};
+		if(auto leaf = spare.exchange(nullptr, std::memory_order_acquire))
+			return leaf;
+		return _map_page_map_leaf();
+	}
+
+	// Keeps an unused leaf for the next _take_spare_leaf() or unmaps it.
+	void _put_spare_leaf(frame **leaf) {
+		if constexpr (enable_page_map) {
+			if(!leaf)
+				return;
+			std::atomic_ref<frame **> spare{_page_map.spare_leaf};
+			frame **expected = nullptr;
+			if(!spare.compare_exchange_strong(expected, leaf, std::memory_order_release,
+					std::memory_order_relaxed))
+				_plcy.unmap(reinterpret_cast<uintptr_t>(leaf), page_map_leaf_size);
+		}
+	}
+
+	// Returns the slot of the page map that corresponds to the superblock at address.
+	// If there is no leaf for the slot yet, a leaf is mapped if allocate is true.
+	// Otherwise (or if mapping the leaf fails), nullptr is returned.
+	frame **_page_map_slot(uintptr_t address, bool allocate) {
+		frame **spare_leaf = nullptr;
+		auto slot = _page_map_slot(address, allocate, spare_leaf);
+		if(spare_leaf)
+			_plcy.unmap(reinterpret_cast<uintptr_t>(spare_leaf), page_map_leaf_size);
+		return slot;
+	}
+
+	// Like _page_map_slot(address, allocate) but if a leaf is needed, spare_leaf is installed
+	// (and reset to nullptr) instead of mapping a new leaf. If spare_leaf is nullptr, a new leaf
+	// is mapped into spare_leaf first; the caller is responsible for unmapping it if unused.
+	frame **_page_map_slot(uintptr_t address, bool allocate, frame **&spare_leaf) {
+		auto key = (address >> sb_shift) & ((size_t{1} << page_map_bits) - 1);
+		std::atomic_ref<frame **> root{_page_map.leaves[key >> page_map_leaf_bits]};
+		auto leaf = root.load(std::memory_order_acquire);
+		if(!leaf) {
+			if(!allocate)
+				return nullptr;
+
+			if(!spare_leaf) {
+				spare_leaf = _map_page_map_leaf();
+				if(!spare_leaf)
+					return nullptr;
+			}
+
+			// Another thread might have installed a leaf concurrently.
+			if(root.compare_exchange_strong(leaf, spare_leaf, std::memory_order_acq_rel)) {
+				leaf = spare_leaf;
+				spare_leaf = nullptr;
+			}
+		}
+		return &leaf[key & ((size_t{1} << page_map_leaf_bits) - 1)];
+	}
+
+	// Like _insert_frame() but takes a leaf from spare_leaf if the page map needs to be extended.
+	// This cannot fail if spare_leaf is non-null.
+	bool _insert_frame(frame *fra, frame **&spare_leaf) {
+		if constexpr (enable_page_map) {
+			auto slot = _page_map_slot(reinterpret_cast<uintptr_t>(fra), true, spare_leaf);
+			if(!slot)
+				return false;
+			std::atomic_ref<frame *>{*slot}.store(fra, std::memory_order_release);
+		}
+		return true;
+	}
+
+	// Makes a new frame visible to _find_frame().
+	// Returns false if the page map could not be extended.
+	bool _insert_frame(frame *fra) {
+		frame **spare_leaf = nullptr;
+		bool inserted = _insert_frame(fra, spare_leaf);
+		if(spare_leaf)
+			_plcy.unmap(reinterpret_cast<uintptr_t>(spare_leaf), page_map_leaf_size);
+		return inserted;
+	}
+
+	void _remove_frame(frame *fra) {
+		if constexpr (enable_page_map) {
+			auto slot = _page_map_slot(reinterpret_cast<uintptr_t>(fra), false);
+			FRG_ASSERT(slot);
+			FRG_ASSERT(std::atomic_ref<frame *>{*slot}.load(std::memory_order_relaxed) == fra);
+			std::atomic_ref<frame *>{*slot}.store(nullptr, std::memory_order_release);
+		}
+	}
+
+	// Returns the frame of an object that was allocated from this pool, or nullptr
+	// if the pointer does not point to such an object.
+	frame *_find_frame(void *p) {
+		auto address = reinterpret_cast<uintptr_t>(p);
+		auto sb = (address - 1) & ~(sb_size - 1);
+		auto slot = _page_map_slot(sb, false);
+		if(!slot)
+			return nullptr;
+
+		// Superblocks that only differ in the bits above address_bits share a slot.
+		auto fra = std::atomic_ref<frame *>{*slot}.load(std::memory_order_acquire);
+		if(reinterpret_cast<uintptr_t>(fra) != sb)
+			return nullptr;
+
+		if(fra->type == frame_type::slab) {
+			auto slb = static_cast<slab_frame *>(fra);
+			if(!slb->contains(p)
+					|| (address - slb->address) % policy_traits::bucket_to_size(slb->index))
+				return nullptr;
+		}else if(address != fra->address) {
+			return nullptr;
+		}
+		return fra;
+	}
+
+	// Returns the frame of an object. If the page map is enabled, this also checks
+	// that the object was allocated from this pool.
+	frame *_frame_of(void *p) {
+		if constexpr (enable_page_map) {
+			auto fra = _find_frame(p);
+			FRG_ASSERT(fra);
+			return fra;
+		}else{
+			auto address = reinterpret_cast<uintptr_t>(p);
+			return reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
 		}
-		_plcy.unmap(sb_base, sb_reservation);
 	}
 
 	//--------------------------------------------------------------------------------------
@@ -433,6 +1940,8 @@ private:
 	void _verify_frame_integrity(frame *fra);
 
 private:
+	using large_cache_type = slab::extent_cache<page_size, large_cache_bytes, large_cache_decay>;
+
 	Policy &_plcy;
 
 	Mutex _tree_mutex;
@@ -440,7 +1949,13 @@ private:
 	frame_tree_type _frame_tree;
 #endif
 	size_t _usedPages;
+	// Protected by _tree_mutex.
+	large_cache_type _large_cache;
+	[[no_unique_address]] std::conditional_t<enable_page_map, page_map, no_page_map> _page_map;
 	bucket _bkts[policy_traits::num_buckets];
+	[[no_unique_address]] magazine_layer<enable_magazines> _magazines;
+	[[no_unique_address]] slab::stats_counters<policy_traits::num_buckets,
+			false, enable_stats> _stats;
 };
 
 // --------------------------------------------------------
@@ -462,95 +1977,416 @@ void *slab_pool<Policy, Mutex>::allocate(size_t length) {
 	if(!length)
 		length = 1;
 
+	void *p;
 	if(length <= policy_traits::max_bucket_size) {
-		int index = policy_traits::size_to_bucket(length);
-		FRG_ASSERT(index <= policy_traits::num_buckets);
-		auto bkt = &_bkts[index];
+		p = _allocate_small(policy_traits::size_to_bucket(length), length);
+	}else{
+		p = _allocate_large(length, huge_padding);
+	}
+	if(!p)
+		return nullptr;
 
-		unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+	if(enable_checking)
+		_verify_integrity();
+	slab::trace(_plcy, 'a', p, length);
+	return p;
+}
 
-		freelist *object;
-		if(bkt->head_slb) {
-			auto slb = bkt->head_slb;
+template<typename Policy, typename Mutex>
+void *slab_pool<Policy, Mutex>::allocate_aligned(size_t length, size_t alignment) {
+	FRG_ASSERT(is_p2(alignment));
 
-			object = slb->available;
-			FRG_ASSERT(object);
-			FRG_ASSERT(slb->contains(object));
-			if(object->link && !slb->contains(object->link))
-				FRG_ASSERT(!"slab_pool corruption. Possible write to unallocated object");
-			slb->available = object->link;
-			slb->num_reserved++;
+	if(enable_checking)
+		_verify_integrity();
 
-			if(!slb->available) {
-				bkt->partial_tree.remove(slb);
-				bkt->head_slb = bkt->partial_tree.first();
+	if(!length)
+		length = 1;
+
+	// Slabs are aligned to sb_size and objects are placed at multiples of their bucket's
+	// size, relative to the start of the slab. Hence, objects are aligned to the largest
+	// power of two that divides their bucket's size. Find the smallest such bucket.
+	void *p = nullptr;
+	if(alignment < page_size) {
+		size_t min_size = length < alignment ? alignment : length;
+		if(min_size <= policy_traits::max_bucket_size) {
+			int index = policy_traits::size_to_bucket(min_size);
+			while(index < policy_traits::num_buckets
+					&& (policy_traits::bucket_to_size(index) & (alignment - 1)))
+				index++;
+			if(index < policy_traits::num_buckets) {
+				p = _allocate_small(index, length);
+				if(!p)
+					return nullptr;
 			}
-		}else{
-			// Call into the Policy without holding locks.
-			bucket_guard.unlock();
+		}
+	}
 
-			auto slb = _construct_slab(index);
-			if(!slb)
-				return nullptr;
+	// Page-aligned and larger requests go through the large path.
+	if(!p) {
+		if(alignment > sb_size)
+			return nullptr;
+		p = _allocate_large(length, alignment < huge_padding ? huge_padding : alignment);
+		if(!p)
+			return nullptr;
+	}
+	FRG_ASSERT(!(reinterpret_cast<uintptr_t>(p) & (alignment - 1)));
 
-			object = slb->available;
-			FRG_ASSERT(object);
-			FRG_ASSERT(slb->contains(object));
-			if(object->link && !slb->contains(object->link))
-				FRG_ASSERT(!"slab_pool corruption. Possible write to unallocated object");
-			slb->available = object->link;
-			slb->num_reserved++;
+	if(enable_checking)
+		_verify_integrity();
+	slab::trace(_plcy, 'a', p, length);
+	return p;
+}
 
-			unique_lock<Mutex> tree_guard(_tree_mutex);
+template<typename Policy, typename Mutex>
+void *slab_pool<Policy, Mutex>::_allocate_small(int index, size_t length) {
+	FRG_ASSERT(index < policy_traits::num_buckets);
+
+	if constexpr (enable_magazines) {
+		// Objects in magazines are completely poisoned.
+		if(auto p = _magazine_allocate(index); p) {
+			if constexpr (slab::has_poisoning_support<Policy>)
+				_plcy.unpoison(p, length);
+			_count([&] (auto &stats) {
+				stats.buckets[index].allocations.add(1);
+				stats.buckets[index].bytes_allocated.add(policy_traits::bucket_to_size(index));
+			});
+			return p;
+		}
+	}
+
+	auto object = _allocate_from_slab(index);
+	if(!object)
+		return nullptr;
+
+	//if(logAllocations)
+	//	std::cout << "frg/slab: Allocate small-object at " << object << std::endl;
+	object->~freelist();
+	if constexpr (slab::has_poisoning_support<Policy>) {
+		_plcy.poison(object, sizeof(freelist));
+		_plcy.unpoison(object, length);
+	}
+	_count([&] (auto &stats) {
+		stats.buckets[index].allocations.add(1);
+		stats.buckets[index].bytes_allocated.add(policy_traits::bucket_to_size(index));
+	});
+	return object;
+}
+
+template<typename Policy, typename Mutex>
+auto slab_pool<Policy, Mutex>::_allocate_from_slab(int index)
+-> freelist * {
+	if constexpr (lock_free_buckets)
+		return _allocate_lock_free(index);
+
+	auto bkt = &_bkts[index];
+
+	unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+
+	freelist *object;
+	if(bkt->head_slb) {
+		auto slb = bkt->head_slb;
+		object = pop_from_slab_(slb);
+
+		if(!slb->has_free()) {
+			bkt->partial_tree.remove(slb);
+			bkt->head_slb = bkt->partial_tree.first();
+		}
+	}else if(bkt->empty_slb) {
+		// Reuse a cached empty slab.
+		auto slb = bkt->empty_slb;
+		bkt->empty_slb = slb->next_empty;
+		bkt->num_empty--;
+		slb->next_empty = nullptr;
+		object = pop_from_slab_(slb);
+
+		if(slb->has_free()) {
+			bkt->partial_tree.insert(slb);
+			bkt->head_slb = slb;
+		}
+	}else{
+		// Call into the Policy without holding locks.
+		bucket_guard.unlock();
+
+		auto slb = _new_slab(index);
+		if(!slb)
+			return nullptr;
+		object = pop_from_slab_(slb);
+
+		// Finally, re-lock the bucket to attach the new slab.
+		bucket_guard.lock();
+
+		if(slb->has_free()) {
+			bkt->partial_tree.insert(slb);
+			if(!bkt->head_slb || slb->address < bkt->head_slb->address)
+				bkt->head_slb = slb;
+		}
+	}
+
+	return object;
+}
+
+template<typename Policy, typename Mutex>
+auto slab_pool<Policy, Mutex>::_new_slab(int index)
+-> slab_frame * {
+	auto slb = _construct_slab(index);
+	if(!slb)
+		return nullptr;
+	if(!_insert_frame(slb)) {
+		_plcy.unmap(slb->sb_base, slb->sb_reservation);
+		return nullptr;
+	}
+	_count([&] (auto &stats) { stats.buckets[index].slabs_mapped.add(1); });
+
+	unique_lock<Mutex> tree_guard(_tree_mutex);
 #ifdef FRG_SLAB_TRACK_REGIONS
-			_frame_tree.insert(slb);
+	_frame_tree.insert(slb);
 #endif
-			_usedPages += (slb->length + huge_padding) / page_size;
-			tree_guard.unlock();
+	_usedPages += (slb->length + huge_padding) / page_size;
+	return slb;
+}
 
-			// Finally, re-lock the bucket to attach the new slab.
+template<typename Policy, typename Mutex>
+auto slab_pool<Policy, Mutex>::_allocate_lock_free(int index)
+-> freelist * {
+	auto bkt = &_bkts[index];
+
+	// Fast path: take a credit of the active slab.
+	auto word = bkt->active.load(std::memory_order_acquire);
+	while(word & max_credits) {
+		if(bkt->active.compare_exchange_weak(word, word - 1,
+				std::memory_order_acquire, std::memory_order_acquire))
+			return pop_reserved_(reinterpret_cast<slab_frame *>(word & ~uintptr_t{max_credits}));
+	}
+
+	unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+	auto slb = _refill_credits(index, bucket_guard);
+	if(!slb)
+		return nullptr;
+	bucket_guard.unlock();
+	return pop_reserved_(slb);
+}
+
+template<typename Policy, typename Mutex>
+auto slab_pool<Policy, Mutex>::_refill_credits(int index, unique_lock<Mutex> &bucket_guard)
+-> slab_frame * {
+	auto bkt = &_bkts[index];
+
+	while(true) {
+		// Another thread might have refilled the credits already.
+		auto word = bkt->active.load(std::memory_order_relaxed);
+		while(word & max_credits) {
+			if(bkt->active.compare_exchange_weak(word, word - 1,
+					std::memory_order_acquire, std::memory_order_relaxed))
+				return reinterpret_cast<slab_frame *>(word & ~uintptr_t{max_credits});
+		}
+
+		if(auto slb = bkt->head_slb; slb) {
+			// Take one credit for ourselves and publish the others.
+			if(auto n = reserve_objects_(slb); n) {
+				bkt->active.store(reinterpret_cast<uintptr_t>(slb) | (n - 1),
+						std::memory_order_release);
+				return slb;
+			}
+			bkt->head_slb = nullptr;
+			bkt->active.store(0, std::memory_order_relaxed);
+		}
+
+		// Activate the lowest partial slab, a cached empty slab or a new slab.
+		if(auto slb = bkt->partial_tree.first(); slb) {
+			bkt->partial_tree.remove(slb);
+			set_state_(slb, slab_state::partial, slab_state::active);
+			bkt->head_slb = slb;
+		}else if(bkt->empty_slb) {
+			auto slb = bkt->empty_slb;
+			bkt->empty_slb = slb->next_empty;
+			bkt->num_empty--;
+			slb->next_empty = nullptr;
+			set_state_(slb, slab_state::empty, slab_state::active);
+			bkt->head_slb = slb;
+		}else{
+			// Call into the Policy without holding locks.
+			bucket_guard.unlock();
+			auto slb = _new_slab(index);
 			bucket_guard.lock();
+			if(!slb)
+				return nullptr;
 
-			FRG_ASSERT(slb->available);
-			bkt->partial_tree.insert(slb);
-			if(!bkt->head_slb || slb->address < bkt->head_slb->address)
+			if(!bkt->head_slb) {
 				bkt->head_slb = slb;
+			}else{
+				// Another thread activated a slab in the meantime; keep the new slab for later.
+				set_state_(slb, slab_state::active, slab_state::empty);
+				if(bkt->num_empty < max_empty_slabs) {
+					slb->next_empty = bkt->empty_slb;
+					bkt->empty_slb = slb;
+					bkt->num_empty++;
+				}else{
+					bucket_guard.unlock();
+					_release_slab(slb);
+					bucket_guard.lock();
+				}
+			}
 		}
+	}
+}
 
-		bucket_guard.unlock();
+template<typename Policy, typename Mutex>
+void *slab_pool<Policy, Mutex>::_magazine_allocate(int index) {
+	auto &cpu = _cpu_magazines(index);
+	auto bkt = &_bkts[index];
+	auto depot = &_magazines.depots[index];
+
+	magazine *excess = nullptr;
+	void *p = nullptr;
+	{
+		unique_lock<Mutex> cpu_guard(cpu.mutex);
+		if(!cpu.loaded || !cpu.loaded->rounds) {
+			if(cpu.previous && cpu.previous->rounds) {
+				FRG_ASSERT(cpu.previous->rounds == magazine_size);
+				auto mag = cpu.loaded;
+				cpu.loaded = cpu.previous;
+				cpu.previous = mag;
+			}else{
+				// Exchange the previous (empty) magazine for a full one from the depot.
+				unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+				if(!depot->full)
+					return nullptr;
+				auto mag = depot->full;
+				depot->full = mag->next;
+
+				if(cpu.previous) {
+					if(depot->num_empty < max_empty_magazines) {
+						cpu.previous->next = depot->empty;
+						depot->empty = cpu.previous;
+						depot->num_empty++;
+					}else{
+						excess = cpu.previous;
+					}
+				}
+				cpu.previous = cpu.loaded;
+				cpu.loaded = mag;
+			}
+		}
 
-		//if(logAllocations)
-		//	std::cout << "frg/slab: Allocate small-object at " << object << std::endl;
-		object->~freelist();
-		if constexpr (slab::has_poisoning_support<Policy>) {
-			_plcy.poison(object, sizeof(freelist));
-			_plcy.unpoison(object, length);
+		FRG_ASSERT(cpu.loaded->rounds);
+		p = cpu.loaded->objects[--cpu.loaded->rounds];
+	}
+
+	// Call into the slab layer without holding locks.
+	if(excess)
+		_destroy_magazine(excess);
+	return p;
+}
+
+template<typename Policy, typename Mutex>
+bool slab_pool<Policy, Mutex>::_magazine_free(int index, void *p) {
+	auto &cpu = _cpu_magazines(index);
+	auto bkt = &_bkts[index];
+	auto depot = &_magazines.depots[index];
+
+	auto try_push = [&] () -> bool {
+		unique_lock<Mutex> cpu_guard(cpu.mutex);
+		if(!cpu.loaded || cpu.loaded->rounds == magazine_size) {
+			if(cpu.previous && !cpu.previous->rounds) {
+				auto mag = cpu.loaded;
+				cpu.loaded = cpu.previous;
+				cpu.previous = mag;
+			}else{
+				// Exchange the previous (full) magazine for an empty one from the depot.
+				unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+				if(!depot->empty)
+					return false;
+				auto mag = depot->empty;
+				depot->empty = mag->next;
+				depot->num_empty--;
+
+				if(cpu.previous) {
+					cpu.previous->next = depot->full;
+					depot->full = cpu.previous;
+				}
+				cpu.previous = cpu.loaded;
+				cpu.loaded = mag;
+			}
 		}
-		if(enable_checking)
-			_verify_integrity();
-		slab::trace(_plcy, 'a', object, length);
-		return object;
-	}else{
-		auto area_size = (length + page_size - 1) & ~(page_size - 1);
-		auto fra = _construct_large(area_size);
-		if(!fra)
-			return nullptr;
 
-		unique_lock<Mutex> tree_guard(_tree_mutex);
+		FRG_ASSERT(cpu.loaded->rounds < magazine_size);
+		cpu.loaded->objects[cpu.loaded->rounds++] = p;
+		return true;
+	};
+
+	while(!try_push()) {
+		// Allocate an empty magazine without holding locks and retry.
+		auto mag = _allocate_magazine();
+		if(!mag)
+			return false;
+
+		unique_lock<Mutex> bucket_guard(bkt->bucket_mutex);
+		mag->next = depot->empty;
+		depot->empty = mag;
+		depot->num_empty++;
+	}
+	return true;
+}
+
+template<typename Policy, typename Mutex>
+auto slab_pool<Policy, Mutex>::_allocate_magazine()
+-> magazine * {
+	static_assert(sizeof(magazine) <= policy_traits::max_bucket_size,
+			"Magazines must fit into a bucket");
+
+	auto object = _allocate_from_slab(policy_traits::size_to_bucket(sizeof(magazine)));
+	if(!object)
+		return nullptr;
+	object->~freelist();
+	if constexpr (slab::has_poisoning_support<Policy>) {
+		_plcy.poison(object, sizeof(freelist));
+		_plcy.unpoison(object, sizeof(magazine));
+	}
+	return new (object) magazine{.next = nullptr, .rounds = 0, .objects = {}};
+}
+
+template<typename Policy, typename Mutex>
+void slab_pool<Policy, Mutex>::_destroy_magazine(magazine *mag) {
+	auto slab_of = [] (void *p) {
+		auto address = reinterpret_cast<uintptr_t>(p);
+		auto sup = reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
+		FRG_ASSERT(sup->type == frame_type::slab);
+		return static_cast<slab_frame *>(sup);
+	};
+
+	for(size_t i = 0; i < mag->rounds; i++)
+		free_to_slab_(slab_of(mag->objects[i]), mag->objects[i]);
+	free_to_slab_(slab_of(mag), mag);
+}
+
+template<typename Policy, typename Mutex>
+void *slab_pool<Policy, Mutex>::_allocate_large(size_t length, size_t alignment) {
+	FRG_ASSERT(alignment >= huge_padding);
+	FRG_ASSERT(alignment <= sb_size);
+	auto area_size = (length + page_size - 1) & ~(page_size - 1);
+	auto fra = _construct_large(area_size, alignment);
+	if(!fra)
+		return nullptr;
+	if(!_insert_frame(fra)) {
+		_plcy.unmap(fra->sb_base, fra->sb_reservation);
+		return nullptr;
+	}
+
+	unique_lock<Mutex> tree_guard(_tree_mutex);
 #ifdef FRG_SLAB_TRACK_REGIONS
-		_frame_tree.insert(fra);
+	_frame_tree.insert(fra);
 #endif
-		_usedPages += (fra->length + huge_padding) / page_size;
-		tree_guard.unlock();
+	_usedPages += _large_pages(fra);
+	tree_guard.unlock();
+	_count([&] (auto &stats) {
+		stats.large.allocations.add(1);
+		stats.large.bytes_allocated.add(fra->length);
+	});
 
-		//if(logAllocations)
-		//	std::cout << "frg/slab: Allocate large-object at " <<
-		//			(void *)fra->address << std::endl;
-		if(enable_checking)
-			_verify_integrity();
-		slab::trace(_plcy, 'a', reinterpret_cast<void *>(fra->address), length);
-		return reinterpret_cast<void *>(fra->address);
-	}
+	//if(logAllocations)
+	//	std::cout << "frg/slab: Allocate large-object at " <<
+	//			(void *)fra->address << std::endl;
+	return reinterpret_cast<void *>(fra->address);
 }
 
 template<typename Policy, typename Mutex>
@@ -566,8 +2402,7 @@ void *slab_pool<Policy, Mutex>::realloc(void *p, size_t new_size) {
 		return nullptr;
 	}
 
-	auto address = reinterpret_cast<uintptr_t>(p);
-	auto sup = reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
+	auto sup = _frame_of(p);
 	size_t current_size;
 	if(sup->type == frame_type::slab) {
 		auto slb = static_cast<slab_frame *>(sup);
@@ -576,6 +2411,15 @@ void *slab_pool<Policy, Mutex>::realloc(void *p, size_t new_size) {
 		current_size = policy_traits::bucket_to_size(slb->index);
 	}else{
 		FRG_ASSERT(sup->type == frame_type::large);
+		if constexpr (slab::has_remap_support<Policy, uintptr_t>) {
+			if(auto new_p = remap_huge_(sup, p, new_size)) {
+				if(new_p != p) {
+					slab::trace(_plcy, 'f', p, 0);
+					slab::trace(_plcy, 'a', new_p, new_size);
+				}
+				return new_p;
+			}
+		}
 		if(reallocate_huge_(sup, p, new_size))
 			return p;
 		current_size = sup->length;
@@ -604,8 +2448,7 @@ void slab_pool<Policy, Mutex>::free(void *p) {
 	//if(logAllocations)
 	//	std::cout << "frg/slab: Free " << p << std::endl;
 
-	auto address = reinterpret_cast<uintptr_t>(p);
-	auto sup = reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
+	auto sup = _frame_of(p);
 	if(sup->type == frame_type::slab) {
 		auto slb = static_cast<slab_frame *>(sup);
 		free_in_slab_(slb, p);
@@ -631,8 +2474,7 @@ void slab_pool<Policy, Mutex>::deallocate(void *p, size_t size) {
 	//if(logAllocations)
 	//	std::cout << "frg/slab: Free " << p << std::endl;
 
-	auto address = reinterpret_cast<uintptr_t>(p);
-	auto sup = reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
+	auto sup = _frame_of(p);
 	if(sup->type == frame_type::slab) {
 		auto slb = static_cast<slab_frame *>(sup);
 		FRG_ASSERT(size <= policy_traits::bucket_to_size(slb->index));
@@ -655,8 +2497,15 @@ size_t slab_pool<Policy, Mutex>::get_size(void *p) {
 	if(!p)
 		return 0;
 
-	auto address = reinterpret_cast<uintptr_t>(p);
-	auto sup = reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
+	frame *sup;
+	if constexpr (enable_page_map) {
+		sup = _find_frame(p);
+		if(!sup)
+			return 0;
+	}else{
+		auto address = reinterpret_cast<uintptr_t>(p);
+		sup = reinterpret_cast<frame *>((address - 1) & ~(sb_size - 1));
+	}
 
 	if(sup->type == frame_type::slab) {
 		auto slb = static_cast<slab_frame *>(sup);
@@ -668,6 +2517,79 @@ size_t slab_pool<Policy, Mutex>::get_size(void *p) {
 }
 
 
+template<typename Policy, typename Mutex>
+void slab_pool<Policy, Mutex>::purge() {
+	// Return all objects in magazines to their slabs first.
+	if constexpr (enable_magazines) {
+		for(int i = 0; i < policy_traits::num_buckets; i++) {
+			magazine *mags = nullptr;
+			auto collect = [&] (magazine *mag) {
+				if(!mag)
+					return;
+				mag->next = mags;
+				mags = mag;
+			};
+
+			for(size_t cpu = 0; cpu < max_cpus; cpu++) {
+				auto &cm = _magazines.cpus[cpu][i];
+				unique_lock<Mutex> cpu_guard(cm.mutex);
+				collect(cm.loaded);
+				collect(cm.previous);
+				cm.loaded = nullptr;
+				cm.previous = nullptr;
+			}
+
+			{
+				auto depot = &_magazines.depots[i];
+				unique_lock<Mutex> bucket_guard(_bkts[i].bucket_mutex);
+				for(auto lists : {depot->full, depot->empty}) {
+					while(lists) {
+						auto next = lists->next;
+						collect(lists);
+						lists = next;
+					}
+				}
+				depot->full = nullptr;
+				depot->empty = nullptr;
+				depot->num_empty = 0;
+			}
+
+			while(mags) {
+				auto next = mags->next;
+				_destroy_magazine(mags);
+				mags = next;
+			}
+		}
+	}
+
+	{
+		uintptr_t evicted = 0;
+		unique_lock<Mutex> tree_guard(_tree_mutex);
+		_large_cache.clear([&] (uintptr_t base, size_t size) {
+			new (reinterpret_cast<void *>(base)) evicted_extent{evicted, size};
+			evicted = base;
+		});
+		tree_guard.unlock();
+		_unmap_evicted(evicted);
+	}
+
+	for(auto &bkt : _bkts) {
+		unique_lock<Mutex> bucket_guard(bkt.bucket_mutex);
+		if constexpr (lock_free_buckets)
+			deactivate_slab_(&bkt);
+		auto slb = bkt.empty_slb;
+		bkt.empty_slb = nullptr;
+		bkt.num_empty = 0;
+		bucket_guard.unlock();
+
+		while(slb) {
+			auto next = slb->next_empty;
+			_release_slab(slb);
+			slb = next;
+		}
+	}
+}
+
 template<typename Policy, typename Mutex>
 auto slab_pool<Policy, Mutex>::_construct_slab(int index)
 -> slab_frame * {
@@ -696,62 +2618,113 @@ auto slab_pool<Policy, Mutex>::_construct_slab(int index)
 	while(overhead < sizeof(slab_frame)) // FIXME.
 		overhead += item_size;
 	FRG_ASSERT(overhead < slabsize);
+	// Bucket sizes are not necessarily powers of two, so the last object must not
+	// extend beyond the end of the slab.
+	auto length = (slabsize - overhead) / item_size * item_size;
 
 	if constexpr (slab::has_poisoning_support<Policy>)
 		_plcy.unpoison(reinterpret_cast<void *>(address), sizeof(slab_frame));
 	auto slb = new (reinterpret_cast<void *>(address)) slab_frame(
-			address + overhead, slabsize - overhead, index);
+			address + overhead, length, index);
 	slb->sb_base = sb_base;
 	slb->sb_reservation = sb_reservation;
 
 	//if(logAllocations)
 	//	std::cout << "frb/slab: New area at " << area << std::endl;
 
-	// Partition the slab into individual objects.
-	freelist *first = nullptr;
-	for(size_t off = 0; off < slb->length; off += item_size) {
-		if constexpr (slab::has_poisoning_support<Policy>)
-			_plcy.unpoison(reinterpret_cast<void *>(slb->address + off), sizeof(freelist));
-		auto object = new (reinterpret_cast<void *>(slb->address + off)) freelist;
-		object->link = first;
-		first = object;
-		//infoLogger() << "[slab] fill " << chunk << frg::endLog;
-	}
-	slb->available = first;
-
+	// Objects are carved off lazily by pop_from_slab_(), such that we do not touch
+	// all pages of the slab up front.
 	return slb;
 }
 
 template<typename Policy, typename Mutex>
-auto slab_pool<Policy, Mutex>::_construct_large(size_t area_size)
+void slab_pool<Policy, Mutex>::_release_slab(slab_frame *slb) {
+	FRG_ASSERT(!slb->num_reserved);
+	_remove_frame(slb);
+
+	// Remove the slab from the area-list.
+	{
+		unique_lock<Mutex> tree_guard(_tree_mutex);
+
+#ifdef FRG_SLAB_TRACK_REGIONS
+		_frame_tree.remove(slb);
+#endif
+		_usedPages -= (slb->length + huge_padding) / page_size;
+	}
+	_count([&] (auto &stats) {
+		stats.buckets[slb->index].slabs_unmapped.add(1);
+		stats.buckets[slb->index].bytes_released.add(slb->carve - slb->address);
+	});
+
+	// Note: we cannot access slb after poison().
+	auto sb_base = slb->sb_base;
+	auto sb_reservation = slb->sb_reservation;
+	auto obj_address = slb->address;
+	auto obj_size = slb->length;
+	if constexpr (slab::has_poisoning_support<Policy>) {
+		_plcy.unpoison_expand(reinterpret_cast<void *>(obj_address), obj_size);
+		_plcy.poison(reinterpret_cast<void *>(obj_address), obj_size);
+		_plcy.poison(slb, sizeof(slab_frame));
+	}
+	_plcy.unmap(sb_base, sb_reservation);
+}
+
+// The object starts at an offset of padding from the (sb_size aligned) frame header.
+// padding must be a multiple of the page size that is at most sb_size.
+template<typename Policy, typename Mutex>
+auto slab_pool<Policy, Mutex>::_construct_large(size_t area_size, size_t padding)
 -> frame * {
 //	frg::infoLogger() << "Allocate new area for " << (void *)area_size << frg::endLog;
 
 	// Allocate virtual memory for the frame.
 	FRG_ASSERT(!(area_size & (page_size - 1)));
+	FRG_ASSERT(!(padding & (page_size - 1)));
+	FRG_ASSERT(padding >= huge_padding && padding <= sb_size);
 	size_t sb_reservation;
+	if constexpr (is_detected_v<policy_map_aligned_t, Policy>) {
+		sb_reservation = area_size + padding;
+	} else {
+		sb_reservation = area_size + padding + sb_size;
+	}
+
+	// Try to reuse a cached extent first. Cached extents were mapped in the same way
+	// (i.e., they are aligned to sb_size if the Policy supports aligned mappings).
 	uintptr_t sb_base;
+	{
+		unique_lock<Mutex> tree_guard(_tree_mutex);
+		size_t extent_size;
+		sb_base = _large_cache.take(sb_reservation, extent_size);
+		if(sb_base)
+			sb_reservation = extent_size;
+	}
+
+	if constexpr (slab::has_poisoning_support<Policy>) {
+		if(sb_base)
+			_plcy.poison(reinterpret_cast<void *>(sb_base), large_cache_type::entry_size);
+	}
+
 	uintptr_t address;
 	if constexpr (is_detected_v<policy_map_aligned_t, Policy>) {
-		sb_reservation = area_size + huge_padding;
-		sb_base = _plcy.map(sb_reservation, sb_size);
+		if(!sb_base)
+			sb_base = _plcy.map(sb_reservation, sb_size);
 		if(!sb_base)
 			return nullptr;
 		address = sb_base;
 	} else {
-		sb_reservation = area_size + huge_padding + sb_size;
-		sb_base = _plcy.map(area_size + huge_padding + sb_size);
+		if(!sb_base)
+			sb_base = _plcy.map(sb_reservation);
 		if(!sb_base)
 			return nullptr;
 		address = (sb_base + sb_size - 1) & ~(sb_size - 1);
 	}
+	FRG_ASSERT(address + padding + area_size <= sb_base + sb_reservation);
 	if constexpr (slab::has_poisoning_support<Policy>) {
 		_plcy.unpoison(reinterpret_cast<void *>(address), sizeof(frame));
-		_plcy.unpoison(reinterpret_cast<void *>(address + huge_padding), area_size);
+		_plcy.unpoison(reinterpret_cast<void *>(address + padding), area_size);
 	}
 
 	auto fra = new ((void *)address) frame(frame_type::large,
-			address + huge_padding, area_size);
+			address + padding, area_size);
 	fra->sb_base = sb_base;
 	fra->sb_reservation = sb_reservation;
 
@@ -814,6 +2787,10 @@ public:
 		pool_->free(pointer);
 	}
 
+	void *allocate_aligned(size_t size, size_t alignment) {
+		return pool_->allocate_aligned(size, alignment);
+	}
+
 	void *reallocate(void *pointer, size_t new_size) {
 		return pool_->realloc(pointer, new_size);
 	}
@@ -7,5 +7,6 @@
 #else
 extern "C" {
 void *memcpy(void *dest, const void *src, size_t n);
+void *memmove(void *dest, const void *src, size_t n);
 }
 #endif
@@ -1,11 +1,19 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <thread>
 #include <unordered_map>
 #include <numeric>
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 
+#include <frg/slab.hpp>
+
 #include <string.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -33,16 +41,27 @@ struct mapped_file {
 
 		size = st.st_size;
 
-		data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, _fd, 0);
+		data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, _fd, 0);
 		if (data == MAP_FAILED) {
 			data = nullptr;
 			perror("failed to mmap file");
 			return;
 		}
 
+		// Traces may be larger than RAM, see discard().
+		madvise(data, size, MADV_SEQUENTIAL);
 		close(_fd);
 	}
 
+	// Drops the pages of [begin, end) that will not be accessed again.
+	void discard(size_t begin, size_t end) {
+		size_t page_size = sysconf(_SC_PAGESIZE);
+		begin = (begin + page_size - 1) & ~(page_size - 1);
+		end &= ~(page_size - 1);
+		if (begin < end)
+			madvise(static_cast<char *>(data) + begin, end - begin, MADV_DONTNEED);
+	}
+
 	~mapped_file() {
 		munmap(data, size);
 	}
@@ -51,129 +70,694 @@ struct mapped_file {
 	size_t size;
 };
 
-enum class type {
+enum class type : uint8_t {
 	allocation,
 	deallocation
 };
 
-struct alloc_log {
+// Interns stack traces so that records only carry a 32-bit id and each
+// distinct stack is held in memory once. Safe to call intern() from
+// multiple threads; get() must not race with intern().
+struct stack_table {
+	uint32_t intern(std::span<const uintptr_t> frames) {
+		size_t hash = hash_frames(frames);
+		size_t index = hash % num_stripes;
+		auto &s = stripes_[index];
+
+		std::lock_guard lock{s.mutex};
+		auto it = s.ids.find(key{frames.data(), frames.size(), hash});
+		if (it != s.ids.end())
+			return it->second;
+
+		auto &stack = s.stacks.emplace_back(frames.begin(), frames.end());
+		uint32_t id = (s.stacks.size() - 1) * num_stripes + index;
+		s.ids.emplace(key{stack.data(), stack.size(), hash}, id);
+		return id;
+	}
+
+	std::span<const uintptr_t> get(uint32_t id) const {
+		return stripes_[id % num_stripes].stacks[id / num_stripes];
+	}
+
+private:
+	static constexpr size_t num_stripes = 64;
+
+	static size_t hash_frames(std::span<const uintptr_t> frames) {
+		size_t v = frames.size();
+
+		for (auto f : frames) {
+			v ^= f + uintptr_t(0x9e3779b9) + (v << 6) + (v >> 2);
+		}
+
+		return v;
+	}
+
+	// Points into the stack stored in the stripe (deque elements never move).
+	struct key {
+		const uintptr_t *frames;
+		size_t num_frames;
+		size_t hash;
+
+		bool operator==(const key &other) const {
+			return num_frames == other.num_frames
+				&& std::equal(frames, frames + num_frames, other.frames);
+		}
+	};
+
+	struct key_hash {
+		size_t operator()(const key &k) const {
+			return k.hash;
+		}
+	};
+
+	struct stripe {
+		std::mutex mutex;
+		std::unordered_map<key, uint32_t, key_hash> ids;
+		std::deque<std::vector<uintptr_t>> stacks;
+	};
+
+	stripe stripes_[num_stripes];
+};
+
+struct record {
+	size_t offset; // Offset of the record in the trace.
+	uintptr_t ptr;
+	size_t size;
+	uint32_t stack;
+	uint32_t index; // Index of the record within its chunk.
 	type t;
+};
+
+// Effect of a record on the heap, as determined by matching.
+// Allocations that are already live and frees of unknown addresses have no effect.
+struct event {
 	uintptr_t ptr;
 	size_t size;
-	std::vector<uintptr_t> stack;
+	uint32_t stack;
+	int8_t sign; // +1 for allocations, -1 for frees, 0 for no effect.
 };
 
-namespace std {
+struct live_alloc {
+	size_t size;
+	uint32_t stack;
+};
 
-template <>
-struct hash<std::vector<uintptr_t>> {
-	size_t operator()(const std::vector<uintptr_t> &vec) const {
-		size_t v = vec.size();
+// Double allocation (t == allocation) or free of an unknown address.
+struct diagnostic {
+	size_t offset;
+	uintptr_t ptr;
+	uint32_t first_stack;
+	uint32_t stack;
+	type t;
+};
 
-		for(auto &i : vec) {
-			v ^= i + uintptr_t(0x9e3779b9) + (v << 6) + (v >> 2);
+// Decoding is split in two: scan() walks over records sequentially and
+// handles all state that is carried from one record to the next (the
+// sample interval and the stacks interned by a version 2 tracer), while
+// decode() fully decodes records between two positions found by scan()
+// and can run on multiple threads at once.
+struct trace_reader {
+	trace_reader(const uint8_t *data, size_t size, stack_table &stacks)
+	: data_{data}, size_{size}, stacks_{stacks} { }
+
+	// Returns the offset of the first record or -1 if the format is unsupported.
+	ssize_t parse_header() {
+		if (size_ < 4 || memcmp(data_, "FRGT", 4))
+			return 0;
+
+		size_t i = 4;
+		version = read_varint_(i);
+		if (version != 2) {
+			fprintf(stderr, "unsupported trace format version %d\n", version);
+			return -1;
 		}
+		return i;
+	}
 
-		return v;
+	// Advances i past one record. prev_pointer is the version 2 decoder state.
+	bool scan(size_t &i, uintptr_t &prev_pointer) {
+		char mode = data_[i++];
+
+		if (version == 2) {
+			if (mode == 'i') {
+				sample_interval = read_varint_(i);
+				return true;
+			} else if (mode == 't') {
+				read_varint_(i);
+				return true;
+			}
+
+			prev_pointer = read_delta_(i, prev_pointer);
+			if (mode == 'a')
+				read_varint_(i);
+
+			uintptr_t ref = read_varint_(i);
+			size_t id = ref >> 1;
+			if (ref & 1) {
+				read_frames_(i, scratch_);
+				if (id) {
+					if (interned_.size() <= id)
+						interned_.resize(id + 1);
+					interned_[id] = stacks_.intern(scratch_);
+				}
+			} else if (id >= interned_.size()) {
+				fprintf(stderr, "reference to unknown stack %lu\n", id);
+				return false;
+			}
+		} else {
+			uintptr_t pointer = read_word_(i);
+			if (mode == 'a')
+				read_word_(i);
+			while (i < size_ && read_word_(i) != 0xA5A5A5A5A5A5A5A5)
+				;
+
+			if (mode == 'i')
+				sample_interval = pointer;
+		}
+
+		return true;
+	}
+
+	// Decodes the record at i into r and advances i past it.
+	// Returns false for records that do not describe an allocation or free.
+	bool decode(size_t &i, uintptr_t &prev_pointer, std::vector<uintptr_t> &frames, record &r) const {
+		r.offset = i;
+		r.index = 0;
+		char mode = data_[i++];
+		r.t = mode == 'a' ? type::allocation : type::deallocation;
+		r.size = 0;
+
+		if (version == 2) {
+			if (mode == 'i' || mode == 't') {
+				read_varint_(i);
+				return false;
+			}
+
+			r.ptr = prev_pointer = read_delta_(i, prev_pointer);
+			if (mode == 'a')
+				r.size = read_varint_(i);
+
+			uintptr_t ref = read_varint_(i);
+			size_t id = ref >> 1;
+			if (ref & 1) {
+				read_frames_(i, frames);
+				r.stack = id ? interned_[id] : stacks_.intern(frames);
+			} else {
+				r.stack = interned_[id];
+			}
+		} else {
+			r.ptr = read_word_(i);
+			if (mode == 'a')
+				r.size = read_word_(i);
+
+			frames.clear();
+			while (i < size_) {
+				uintptr_t frame = read_word_(i);
+				if (frame == 0xA5A5A5A5A5A5A5A5)
+					break;
+				frames.push_back(frame);
+			}
+
+			if (mode == 'i')
+				return false;
+			r.stack = stacks_.intern(frames);
+		}
+
+		return true;
+	}
+
+	int version = 1;
+
+	// Non-zero if the trace only contains a sample of all allocations.
+	uintptr_t sample_interval = 0;
+
+private:
+	// Version 1 of the trace format uses fixed-size little endian words.
+	uintptr_t read_word_(size_t &i) const {
+		uintptr_t target = 0;
+		for (int k = 0; k < 8 && i < size_; k++)
+			target |= (uintptr_t(data_[i++]) << (k * 8));
+
+		return target;
+	}
+
+	// Version 2 of the trace format uses LEB128 varints, see slab::trace_encoder_v2.
+	uintptr_t read_varint_(size_t &i) const {
+		uintptr_t target = 0;
+		for (int shift = 0; i < size_ && shift < 64; shift += 7) {
+			uint8_t byte = data_[i++];
+			target |= uintptr_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				break;
+		}
+
+		return target;
+	}
+
+	uintptr_t read_delta_(size_t &i, uintptr_t prev) const {
+		uintptr_t zigzag = read_varint_(i);
+		auto delta = static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1);
+		return prev + delta;
+	}
+
+	void read_frames_(size_t &i, std::vector<uintptr_t> &frames) const {
+		uintptr_t num_frames = read_varint_(i);
+		uintptr_t frame = 0;
+		frames.clear();
+		for (uintptr_t k = 0; k < num_frames && i < size_; k++) {
+			frame = read_delta_(i, frame);
+			frames.push_back(frame);
+		}
+	}
+
+	const uint8_t *data_;
+	size_t size_;
+	stack_table &stacks_;
+
+	// Maps stack ids of a version 2 trace to ids in stacks_.
+	std::vector<uint32_t> interned_{0};
+	std::vector<uintptr_t> scratch_;
+};
+
+// Size classes of slab_pool and sharded_slab::pool for the given Policy::small_step_exp.
+template<unsigned int StepExp>
+struct size_class_policy {
+	static constexpr unsigned int small_step_exp = StepExp;
+};
+
+struct size_classes {
+	template<unsigned int StepExp>
+	static size_classes make() {
+		using traits = frg::slab_policy_traits<size_class_policy<StepExp>>;
+		size_classes sc;
+		for (size_t b = 0; b < traits::num_buckets; b++)
+			sc.sizes.push_back(traits::bucket_to_size(b));
+		sc.size_to_bucket = &traits::size_to_bucket;
+		return sc;
+	}
+
+	// Large objects are mapped individually; they use the last class.
+	size_t classify(size_t size) const {
+		if (size > sizes.back())
+			return sizes.size();
+		return size_to_bucket(size);
+	}
+
+	size_t slot_size(size_t cls, size_t size) const {
+		if (cls == sizes.size())
+			return (size + page_size - 1) & ~(page_size - 1);
+		return sizes[cls];
+	}
+
+	static constexpr size_t page_size = 4096;
+	// Both slab_pool and sharded_slab::pool carve small objects from 256 KiB chunks.
+	static constexpr size_t chunk_size = size_t{1} << 18;
+
+	std::vector<size_t> sizes;
+	size_t (*size_to_bucket)(size_t);
+};
+
+// Counters indexed by a small integer (a stack id or size class) whose values
+// are also needed at the time of the peak. Instead of copying all counters
+// whenever a new peak is reached, we only track the changes since the last peak.
+struct peak_counters {
+	struct value {
+		double objects = 0;
+		double bytes = 0;
+	};
+
+	void add(size_t idx, double objects, double bytes) {
+		if (idx >= current_.size()) {
+			current_.resize(idx + 1);
+			since_peak_.resize(idx + 1);
+			touched_.resize(idx + 1);
+		}
+		current_[idx].objects += objects;
+		current_[idx].bytes += bytes;
+		since_peak_[idx].objects += objects;
+		since_peak_[idx].bytes += bytes;
+		if (!touched_[idx]) {
+			touched_[idx] = true;
+			touched_list_.push_back(idx);
+		}
+	}
+
+	void new_peak() {
+		for (auto idx : touched_list_) {
+			since_peak_[idx] = {};
+			touched_[idx] = false;
+		}
+		touched_list_.clear();
+	}
+
+	size_t size() const {
+		return current_.size();
+	}
+
+	value current(size_t idx) const {
+		return idx < current_.size() ? current_[idx] : value{};
 	}
+
+	value at_peak(size_t idx) const {
+		if (idx >= current_.size())
+			return {};
+		return {current_[idx].objects - since_peak_[idx].objects,
+			current_[idx].bytes - since_peak_[idx].bytes};
+	}
+
+private:
+	std::vector<value> current_;
+	std::vector<value> since_peak_;
+	std::vector<bool> touched_;
+	std::vector<uint32_t> touched_list_;
 };
 
-} // namespace std
+// Replays the effects of all records in trace order to track live memory over
+// time, the peak of live bytes and the state of the simulated size classes.
+struct heap_profile {
+	heap_profile(size_classes classes, FILE *timeline, size_t interval)
+	: classes{std::move(classes)}, timeline{timeline}, interval{interval},
+			allocations(this->classes.sizes.size() + 1) {
+		if (timeline)
+			fprintf(timeline, "record,live_objects,live_bytes,slot_bytes,held_chunks,min_chunks\n");
+	}
+
+	void apply(const event &e, double weight) {
+		if (e.sign) {
+			size_t cls = classes.classify(e.size);
+			double objects = e.sign * weight;
+			double bytes = objects * e.size;
+			double slot_bytes = objects * classes.slot_size(cls, e.size);
+
+			live_objects += objects;
+			live_bytes += bytes;
+			live_slot_bytes += slot_bytes;
+			by_stack.add(e.stack, objects, bytes);
+			by_class.add(cls, objects, slot_bytes);
+			requested_by_class.add(cls, objects, bytes);
+			if (e.sign > 0)
+				allocations[cls] += weight;
+
+			// Chunks that contain live small objects cannot be released by the allocator.
+			if (cls < classes.sizes.size()) {
+				auto it = chunk_objects.try_emplace(e.ptr / size_classes::chunk_size, 0).first;
+				if (e.sign > 0 && !it->second++) {
+					held_chunks++;
+				} else if (e.sign < 0 && !--it->second) {
+					held_chunks--;
+					chunk_objects.erase(it);
+				}
+			}
+			max_held_chunks = std::max(max_held_chunks, held_chunks);
+
+			if (live_bytes > peak_bytes) {
+				peak_record = num_records;
+				peak_bytes = live_bytes;
+				peak_objects = live_objects;
+				peak_slot_bytes = live_slot_bytes;
+				peak_held_chunks = held_chunks;
+				by_stack.new_peak();
+				by_class.new_peak();
+				requested_by_class.new_peak();
+			}
+		}
+
+		if (timeline && !(num_records % interval))
+			fprintf(timeline, "%lu,%.0f,%.0f,%.0f,%lu,%lu\n", num_records, live_objects,
+					live_bytes, live_slot_bytes, held_chunks, min_chunks(false));
+		num_records++;
+	}
+
+	// Lower bound on the chunks needed to hold the live small objects.
+	size_t min_chunks(bool at_peak) const {
+		size_t n = 0;
+		for (size_t cls = 0; cls < classes.sizes.size(); cls++) {
+			auto v = at_peak ? by_class.at_peak(cls) : by_class.current(cls);
+			size_t per_chunk = size_classes::chunk_size / classes.sizes[cls];
+			n += (static_cast<size_t>(std::llround(v.objects)) + per_chunk - 1) / per_chunk;
+		}
+		return n;
+	}
+
+	size_classes classes;
+	FILE *timeline;
+	size_t interval;
+
+	size_t num_records = 0;
+	double live_objects = 0;
+	double live_bytes = 0;
+	double live_slot_bytes = 0;
+	size_t held_chunks = 0;
+	size_t max_held_chunks = 0;
+
+	size_t peak_record = 0;
+	double peak_objects = 0;
+	double peak_bytes = 0;
+	double peak_slot_bytes = 0;
+	size_t peak_held_chunks = 0;
+
+	peak_counters by_stack;
+	// Objects and slot bytes per size class.
+	peak_counters by_class;
+	// Objects and requested bytes per size class.
+	peak_counters requested_by_class;
+	std::vector<double> allocations;
+	std::unordered_map<uintptr_t, uint32_t> chunk_objects;
+};
 
 int main(int argc, char **argv) {
-	if (argc != 3) {
-		fprintf(stderr, "usage: <input file> <executable>\n");
+	auto usage = [] {
+		fprintf(stderr, "usage: [-j <threads>] [-t <timeline.csv> [-i <records>]] [-r <report.json>]"
+				" [-c <small_step_exp>] <input file> <executable>\n");
+	};
+
+	size_t num_threads = 1;
+	const char *timeline_path = nullptr;
+	const char *report_path = nullptr;
+	size_t interval = 1 << 16;
+	int small_step_exp = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "j:t:i:r:c:")) != -1) {
+		switch (opt) {
+		case 'j': num_threads = atoi(optarg); break;
+		case 't': timeline_path = optarg; break;
+		case 'i': interval = atol(optarg); break;
+		case 'r': report_path = optarg; break;
+		case 'c': small_step_exp = atoi(optarg); break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+
+	if (num_threads < 1 || !interval || small_step_exp < 0 || small_step_exp > 2) {
+		usage();
 		return 1;
 	}
 
-	mapped_file in{argv[1]};
+	if (argc - optind != 2) {
+		usage();
+		return 1;
+	}
+
+	const char *executable = argv[optind + 1];
+
+	mapped_file in{argv[optind]};
 	if (!in.data)
 		return 1;
 
-	uint8_t *data = static_cast<uint8_t *>(in.data);
-	size_t i = 0;
+	stack_table stacks{};
+	trace_reader reader{static_cast<uint8_t *>(in.data), in.size, stacks};
 
-	auto decode_varint = [](uint8_t *buffer, uintptr_t &target) -> size_t {
-		target = 0;
-		for (int i = 0; i < 8; i++)
-			target |= (uintptr_t(buffer[i]) << (i * 8));
+	ssize_t first_record = reader.parse_header();
+	if (first_record < 0)
+		return 1;
 
-		return 8;
-	};
+	FILE *timeline = nullptr;
+	if (timeline_path && !(timeline = fopen(timeline_path, "w"))) {
+		perror("failed to open timeline file");
+		return 1;
+	}
 
-	auto print_stack = [](const std::vector<uintptr_t> &stack) {
-		for (auto p : stack)
+	FILE *report = nullptr;
+	if (report_path && !(report = fopen(report_path, "w"))) {
+		perror("failed to open report file");
+		return 1;
+	}
+
+	// The profile replays the trace through the size classes of slab_pool.
+	std::optional<heap_profile> profile;
+	if (timeline || report) {
+		size_classes classes;
+		switch (small_step_exp) {
+		case 0: classes = size_classes::make<0>(); break;
+		case 1: classes = size_classes::make<1>(); break;
+		case 2: classes = size_classes::make<2>(); break;
+		}
+		profile.emplace(std::move(classes), timeline, interval);
+	}
+
+	auto print_stack = [&](uint32_t stack) {
+		for (auto p : stacks.get(stack))
 			printf("\t%016lx\n", p);
 	};
 
-	std::vector<alloc_log> logs{};
-	std::unordered_map<uintptr_t, alloc_log *> unmatched_logs{};
-	std::unordered_map<std::vector<uintptr_t>, std::vector<size_t>> grouped_logs{};
-	std::vector<std::pair<std::vector<uintptr_t>, std::vector<size_t>>> leaks{};
+	// An allocation of the given size that was sampled represents
+	// 1 / P(sampled) allocations, see slab::trace_sampler.
+	auto weight = [&](size_t size) -> double {
+		if (!reader.sample_interval)
+			return 1;
+		return 1 / (1 - std::exp(-static_cast<double>(size ? size : 1) / reader.sample_interval));
+	};
+
+	// The trace is processed in windows of up to num_threads chunks.
+	// Each chunk is decoded by one thread, which sorts its records into
+	// shards by address; each shard is then matched by one thread, feeding
+	// it the records of all chunks in trace order. Only live allocations
+	// are kept across windows.
+	constexpr size_t records_per_chunk = size_t{1} << 18;
+
+	struct chunk {
+		size_t begin;
+		size_t end;
+		uintptr_t prev_pointer;
+	};
+
+	std::vector<chunk> chunks{};
+	// buckets[c][s] holds the records of chunk c that belong to shard s.
+	std::vector<std::vector<std::vector<record>>> buckets(num_threads,
+			std::vector<std::vector<record>>(num_threads));
+	std::vector<std::unordered_map<uintptr_t, live_alloc>> live(num_threads);
+	std::vector<std::vector<diagnostic>> diagnostics(num_threads);
+	// events[c][k] holds the effect of the k-th record of chunk c, if we build a profile.
+	std::vector<std::vector<event>> events(num_threads);
+	std::vector<diagnostic> window_diagnostics{};
+
+	auto shard_of = [&](uintptr_t ptr) -> size_t {
+		return ((ptr >> 4) * uint64_t(0x9e3779b97f4a7c15) >> 32) % num_threads;
+	};
+
+	auto run_parallel = [&](auto fn) {
+		if (num_threads == 1) {
+			fn(0);
+			return;
+		}
+
+		std::vector<std::thread> threads{};
+		for (size_t t = 0; t < num_threads; t++)
+			threads.emplace_back(fn, t);
+		for (auto &thread : threads)
+			thread.join();
+	};
+
+	size_t i = first_record;
+	uintptr_t prev_pointer = 0;
 
 	while (i < in.size) {
-		char mode = data[i++];
-		uintptr_t pointer = 0;
-		uintptr_t size = 0;
-		std::vector<uintptr_t> stack;
-		stack.clear();
-
-		i += decode_varint(data + i, pointer);
-		if (mode == 'a')
-			i += decode_varint(data + i, size);
-
-		uintptr_t tmp = 0;
-		while (i < in.size) {
-			i += decode_varint(data + i, tmp);
-			if (tmp == 0xA5A5A5A5A5A5A5A5)
-				break;
+		size_t window_begin = i;
+		chunks.clear();
+		while (chunks.size() < num_threads && i < in.size) {
+			chunk c{i, i, prev_pointer};
+			for (size_t n = 0; n < records_per_chunk && i < in.size; n++) {
+				if (!reader.scan(i, prev_pointer))
+					return 1;
+			}
+			c.end = i;
+			chunks.push_back(c);
+		}
 
-			stack.push_back(tmp);
+		run_parallel([&](size_t t) {
+			for (auto &bucket : buckets[t])
+				bucket.clear();
+			if (t >= chunks.size())
+				return;
+
+			std::vector<uintptr_t> frames{};
+			auto [j, end, prev] = chunks[t];
+			record r;
+			uint32_t index = 0;
+			while (j < end) {
+				if (reader.decode(j, prev, frames, r)) {
+					r.index = index++;
+					buckets[t][shard_of(r.ptr)].push_back(r);
+				}
+			}
+			if (profile)
+				events[t].resize(index);
+		});
+
+		run_parallel([&](size_t s) {
+			for (size_t c = 0; c < chunks.size(); c++) {
+				for (auto &r : buckets[c][s]) {
+					event e{r.ptr, r.size, r.stack, 0};
+					if (r.t == type::allocation) {
+						auto [it, inserted] = live[s].try_emplace(r.ptr, live_alloc{r.size, r.stack});
+						if (inserted)
+							e.sign = 1;
+						else
+							diagnostics[s].push_back({r.offset, r.ptr, it->second.stack, r.stack, r.t});
+					} else if (auto it = live[s].find(r.ptr); it != live[s].end()) {
+						e = {r.ptr, it->second.size, it->second.stack, -1};
+						live[s].erase(it);
+					} else if (r.ptr) {
+						diagnostics[s].push_back({r.offset, r.ptr, 0, r.stack, r.t});
+					}
+
+					if (profile)
+						events[c][r.index] = e;
+				}
+			}
+		});
+
+		in.discard(window_begin, i);
+
+		if (profile) {
+			for (size_t c = 0; c < chunks.size(); c++) {
+				for (auto &e : events[c])
+					profile->apply(e, weight(e.size));
+			}
 		}
 
-		logs.push_back({mode == 'a' ? type::allocation : type::deallocation, pointer, size, stack});
-	}
+		// Report problems in trace order, regardless of the number of threads.
+		window_diagnostics.clear();
+		for (auto &d : diagnostics) {
+			window_diagnostics.insert(window_diagnostics.end(), d.begin(), d.end());
+			d.clear();
+		}
+		std::sort(window_diagnostics.begin(), window_diagnostics.end(),
+			[](auto &a, auto &b) { return a.offset < b.offset; });
 
-	for (auto &l : logs) {
-		if (l.t == type::allocation) {
-			if (unmatched_logs.count(l.ptr)) {
+		for (auto &d : window_diagnostics) {
+			if (d.t == type::allocation) {
 				printf("same address allocated again without matching free for previous call?\n");
-				printf("address %016lx got allocated again despite not being freed!\n", l.ptr);
+				printf("address %016lx got allocated again despite not being freed!\n", d.ptr);
 				printf("first allocation from:\n");
-				print_stack(unmatched_logs[l.ptr]->stack);
+				print_stack(d.first_stack);
 				printf("allocation again from:\n");
-				print_stack(l.stack);
+				print_stack(d.stack);
 			} else {
-				unmatched_logs[l.ptr] = &l;
-			}
-		} else {
-			if (unmatched_logs.count(l.ptr)) {
-				unmatched_logs.erase(l.ptr);
-			} else if (l.ptr) {
 				printf("deallocation of an address that wasn't allocated?\n");
-				printf("address %016lx isn't allocated anywhere at this point!\n", l.ptr);
+				printf("address %016lx isn't allocated anywhere at this point!\n", d.ptr);
 				printf("deallocated from:\n");
-				print_stack(l.stack);
+				print_stack(d.stack);
 			}
 		}
 	}
 
-	for (auto &[ptr, l] : unmatched_logs) {
-		if (grouped_logs.count(l->stack)) {
-			grouped_logs[l->stack].push_back(l->size);
-		} else {
-			grouped_logs[l->stack] = {l->size};
-		}
+	size_t num_leaks = 0;
+	std::unordered_map<uint32_t, std::vector<size_t>> grouped_logs{};
+	for (auto &shard : live) {
+		for (auto &[ptr, a] : shard)
+			grouped_logs[a.stack].push_back(a.size);
+		num_leaks += shard.size();
 	}
 
-	for (auto &[stack, l] : grouped_logs) {
-		leaks.push_back(std::make_pair(stack, l));
-	}
+	std::vector<std::pair<uint32_t, std::vector<size_t>>> leaks{grouped_logs.begin(), grouped_logs.end()};
 
 	std::sort(leaks.begin(), leaks.end(),
 		[](auto &a, auto &b){
-			return std::accumulate(a.second.begin(), a.second.end(), 0)
-				< std::accumulate(b.second.begin(), b.second.end(), 0);
+			return std::accumulate(a.second.begin(), a.second.end(), size_t{0})
+				< std::accumulate(b.second.begin(), b.second.end(), size_t{0});
 		}
 	);
 
@@ -192,7 +776,7 @@ int main(int argc, char **argv) {
 	if (!addr2line_pid) {
 		dup2(stdin_pipe[0], STDIN_FILENO);
 		dup2(stdout_pipe[1], STDOUT_FILENO);
-		execl("/usr/bin/addr2line", "addr2line", "-Cpfse", argv[2], nullptr);
+		execl("/usr/bin/addr2line", "addr2line", "-Cpfse", executable, nullptr);
 	}
 
 	// write to stdin_pipe[1], read from stdout_pipe[0]
@@ -209,15 +793,41 @@ int main(int argc, char **argv) {
 	}
 
 	size_t total_all = 0;
+	double estimated_count_all = 0;
+	double estimated_total_all = 0;
 
 	char *linebuf = nullptr;
 	size_t linecap = 0;
 
+	// Returns the output of addr2line for p, including the trailing newline.
+	auto symbolize = [&](uintptr_t p, bool top) -> const char * {
+		// For stack frames below the top, subtract 1 to resolve the call instruction
+		// and not the next instruction after the call.
+		fprintf(stdin_f, "0x%016lx\n", (!p || top) ? p : (p - 1));
+		fflush(stdin_f);
+		if (getline(&linebuf, &linecap, stdout_f) < 0)
+			return "??\n";
+		return linebuf;
+	};
+
 	for (auto &[stack, l] : leaks) {
-		size_t avg = std::accumulate(l.begin(), l.end(), 0) / l.size();
-		size_t total = std::accumulate(l.begin(), l.end(), 0);
+		size_t avg = std::accumulate(l.begin(), l.end(), size_t{0}) / l.size();
+		size_t total = std::accumulate(l.begin(), l.end(), size_t{0});
 		total_all += total;
-		printf("%lu potential leak(s) found of average size %lu, total size %lu, and all sizes:\n  ", l.size(), avg, total);
+		if (reader.sample_interval) {
+			double estimated_count = 0;
+			double estimated_total = 0;
+			for (auto size : l) {
+				estimated_count += weight(size);
+				estimated_total += weight(size) * size;
+			}
+			estimated_count_all += estimated_count;
+			estimated_total_all += estimated_total;
+			printf("~%.0f potential leak(s) estimated from %lu sample(s) of average size %lu, total size ~%.0f, and all sampled sizes:\n  ",
+				estimated_count, l.size(), avg, estimated_total);
+		} else {
+			printf("%lu potential leak(s) found of average size %lu, total size %lu, and all sizes:\n  ", l.size(), avg, total);
+		}
 
 		std::sort(l.begin(), l.end());
 
@@ -237,26 +847,88 @@ int main(int argc, char **argv) {
 
 		printf("\n  found in:\n");
 		bool top = true;
-		for (auto p : stack) {
-			// For stack frames below the top, subtract 1 to resolve the call instruction
-			// and not the next instruction after the call.
-			fprintf(stdin_f, "0x%016lx\n", (!p || top) ? p : (p - 1));
-			fflush(stdin_f);
-			getline(&linebuf, &linecap, stdout_f);
-
-			printf("\t%016lx -> %s", p, linebuf);
+		for (auto p : stacks.get(stack)) {
+			printf("\t%016lx -> %s", p, symbolize(p, top));
 			top = false;
 		}
 		printf("--------------------------------------\n\n");
 	}
 
+	if (report) {
+		auto &prof = *profile;
+		auto &classes = prof.classes;
+
+		// Stacks that contributed most to the peak.
+		constexpr size_t max_peak_stacks = 10;
+		std::vector<std::pair<uint32_t, peak_counters::value>> peak_stacks{};
+		for (size_t id = 0; id < prof.by_stack.size(); id++) {
+			auto v = prof.by_stack.at_peak(id);
+			if (v.objects > 0.5)
+				peak_stacks.push_back({id, v});
+		}
+		std::sort(peak_stacks.begin(), peak_stacks.end(),
+			[](auto &a, auto &b) { return a.second.bytes > b.second.bytes; });
+		if (peak_stacks.size() > max_peak_stacks)
+			peak_stacks.resize(max_peak_stacks);
+
+		fprintf(report, "{\n\t\"records\": %lu,\n\t\"sample_interval\": %lu,\n", prof.num_records, reader.sample_interval);
+		fprintf(report, "\t\"chunk_size\": %lu,\n\t\"max_held_chunks\": %lu,\n", size_classes::chunk_size, prof.max_held_chunks);
+		fprintf(report, "\t\"peak\": {\n\t\t\"record\": %lu,\n\t\t\"live_objects\": %.0f,\n\t\t\"live_bytes\": %.0f,\n"
+				"\t\t\"slot_bytes\": %.0f,\n\t\t\"held_chunks\": %lu,\n\t\t\"min_chunks\": %lu,\n\t\t\"stacks\": [",
+				prof.peak_record, prof.peak_objects, prof.peak_bytes, prof.peak_slot_bytes,
+				prof.peak_held_chunks, prof.min_chunks(true));
+
+		for (size_t k = 0; k < peak_stacks.size(); k++) {
+			auto &[id, v] = peak_stacks[k];
+			fprintf(report, "%s\n\t\t\t{\"objects\": %.0f, \"bytes\": %.0f, \"frames\": [",
+					k ? "," : "", v.objects, v.bytes);
+
+			bool top = true;
+			for (auto p : stacks.get(id)) {
+				fprintf(report, "%s\n\t\t\t\t{\"address\": \"%016lx\", \"symbol\": \"", top ? "" : ",", p);
+				for (const char *c = symbolize(p, top); *c && *c != '\n'; c++) {
+					if (*c == '"' || *c == '\\')
+						fputc('\\', report);
+					fputc(*c, report);
+				}
+				fprintf(report, "\"}");
+				top = false;
+			}
+			fprintf(report, "]}");
+		}
+		fprintf(report, "\n\t\t]\n\t},\n\t\"size_classes\": [");
+
+		for (size_t cls = 0; cls <= classes.sizes.size(); cls++) {
+			auto peak = prof.by_class.at_peak(cls);
+			auto peak_requested = prof.requested_by_class.at_peak(cls);
+			auto end = prof.by_class.current(cls);
+			if (cls < classes.sizes.size())
+				fprintf(report, "%s\n\t\t{\"size\": %lu, ", cls ? "," : "", classes.sizes[cls]);
+			else
+				fprintf(report, ",\n\t\t{\"size\": \"large\", ");
+			fprintf(report, "\"allocations\": %.0f, \"peak_objects\": %.0f, \"peak_requested_bytes\": %.0f, "
+					"\"peak_slot_bytes\": %.0f, \"end_objects\": %.0f}",
+					prof.allocations[cls], peak.objects, peak_requested.bytes, peak.bytes, end.objects);
+		}
+		fprintf(report, "\n\t]\n}\n");
+		fclose(report);
+	}
+
+	if (timeline)
+		fclose(timeline);
+
 	free(linebuf);
 	fclose(stdin_f);
 	fclose(stdout_f);
 	close(stdin_pipe[1]);
 	close(stdout_pipe[0]);
 
-	printf("total potential leaks: %lu, which is %lu bytes\n", unmatched_logs.size(), total_all);
+	if (reader.sample_interval) {
+		printf("total potential leaks: ~%.0f, which is ~%.0f bytes (estimated from %lu samples, sample interval %lu bytes)\n",
+			estimated_count_all, estimated_total_all, num_leaks, reader.sample_interval);
+	} else {
+		printf("total potential leaks: %lu, which is %lu bytes\n", num_leaks, total_all);
+	}
 
 	kill(addr2line_pid, SIGTERM);
 	int wstatus;
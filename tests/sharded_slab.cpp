@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <atomic>
+#include <map>
 #include <sys/mman.h>
 #include <thread>
 #include <vector>
@@ -36,6 +38,30 @@ TEST(sharded_slab, multiple_sizes) {
 }
 
 // Allocate enough objects to exhaust one chunk.
+struct fine_policy : sharded_slab_policy {
+	static constexpr unsigned int small_step_exp = 2;
+};
+
+TEST(sharded_slab, size_classes) {
+	using traits = frg::slab_policy_traits<fine_policy>;
+	frg::sharded_slab::pool<fine_policy> pool;
+
+	// Allocate enough objects to fill more than one chunk for some buckets.
+	std::vector<void *> objs;
+	for (size_t size = 1; size <= traits::max_bucket_size; size += 7) {
+		void *p = pool.allocate(size);
+		ASSERT_NE(p, nullptr);
+		memset(p, 0xFF, size);
+		EXPECT_EQ(pool.get_size(p), traits::bucket_to_size(traits::size_to_bucket(size)));
+		// Objects are placed at multiples of their size relative to the chunk.
+		EXPECT_EQ((reinterpret_cast<uintptr_t>(p) % frg::sharded_slab::pool<fine_policy>::chunk_boundary)
+				% pool.get_size(p), 0);
+		objs.push_back(p);
+	}
+	for (auto p : objs)
+		pool.deallocate(p);
+}
+
 TEST(sharded_slab, exhaust_chunk) {
 	constexpr size_t count = 20000;
 
@@ -106,6 +132,47 @@ TEST(sharded_slab, cross_thread_deallocation) {
 	}
 }
 
+TEST(sharded_slab, bulk) {
+	constexpr size_t batch = 64;
+	constexpr size_t count = 320 * batch;
+
+	pool_type main_pool;
+	std::vector<void *> objs(count);
+
+	for (size_t size : {size_t{16}, size_t{128}, size_t{100000}}) {
+		size_t n = main_pool.allocate_bulk(size, {objs.data(), 100});
+		ASSERT_EQ(n, 100);
+		for (size_t i = 0; i < n; i++) {
+			ASSERT_NE(objs[i], nullptr);
+			EXPECT_GE(main_pool.get_size(objs[i]), size);
+			memset(objs[i], 0xFF, size);
+		}
+		// Null pointers are skipped.
+		main_pool.deallocate(objs[17]);
+		objs[17] = nullptr;
+		main_pool.deallocate_bulk({objs.data(), n});
+	}
+
+	for (size_t i = 0; i < 5; ++i) {
+		// Allocate in main thread + free in another thread.
+		for (size_t i = 0; i < count; i += batch) {
+			ASSERT_EQ(main_pool.allocate_bulk(128, {objs.data() + i, batch}), batch);
+			for (size_t j = i; j < i + batch; j++)
+				memset(objs[j], 0xFF, 128);
+		}
+		for (size_t i = 0; i < count; i++) {
+			for (size_t j = i + 1; j < i + 2 * batch && j < count; j++)
+				ASSERT_NE(objs[i], objs[j]);
+		}
+		std::thread t([&] {
+			pool_type thread_pool;
+			for (size_t i = 0; i < count; i += batch)
+				thread_pool.deallocate_bulk({objs.data() + i, batch});
+		});
+		t.join();
+	}
+}
+
 TEST(sharded_slab, reallocate) {
 	pool_type pool;
 
@@ -171,6 +238,581 @@ TEST(sharded_slab, get_size) {
 	pool.deallocate(p_large);
 }
 
+TEST(sharded_slab, allocate_aligned) {
+	pool_type pool;
+
+	for (int a = 0; a <= 17; a++) {
+		size_t alignment = size_t{1} << a;
+		for (size_t size : {size_t{1}, size_t{24}, size_t{100}, size_t{5000}, size_t{100000}}) {
+			void *p = pool.allocate_aligned(size, alignment);
+			ASSERT_NE(p, nullptr);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(p) & (alignment - 1), 0);
+			EXPECT_GE(pool.get_size(p), size);
+			memset(p, 0xFF, size);
+			pool.deallocate(p);
+		}
+	}
+
+	// Alignments of chunk_boundary and above are not supported.
+	EXPECT_EQ(pool.allocate_aligned(1, pool_type::chunk_boundary), nullptr);
+}
+
+struct counting_policy : sharded_slab_policy {
+	static inline std::atomic<size_t> mapped_bytes{0};
+
+	void *map(size_t size) {
+		mapped_bytes += size;
+		return sharded_slab_policy::map(size);
+	}
+
+	void unmap(void *p, size_t size) {
+		mapped_bytes -= size;
+		sharded_slab_policy::unmap(p, size);
+	}
+};
+
+using counting_pool_type = frg::sharded_slab::pool<counting_policy>;
+
+// Upper bound on the memory that a single bucket may retain after all objects are freed.
+constexpr size_t max_retained_bytes = (counting_pool_type::max_empty_chunks + 1)
+		* 2 * counting_pool_type::chunk_size;
+
+TEST(sharded_slab, release_empty_chunks) {
+	constexpr size_t count = 200000;
+
+	counting_pool_type pool;
+	std::vector<void *> objs(count);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t i = 0; i < count; i++) {
+			objs[i] = pool.allocate(128);
+			ASSERT_NE(objs[i], nullptr);
+			memset(objs[i], 0xFF, 128);
+		}
+		EXPECT_GT(counting_policy::mapped_bytes.load() - baseline, count * 128);
+
+		for (size_t i = 0; i < count; i++)
+			pool.deallocate(objs[i]);
+		EXPECT_LE(counting_policy::mapped_bytes.load() - baseline, max_retained_bytes);
+	}
+}
+
+TEST(sharded_slab, release_empty_chunks_threaded) {
+	constexpr size_t count = 200000;
+
+	counting_pool_type main_pool;
+	std::vector<void *> objs(count);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	for (size_t i = 0; i < count; i++) {
+		objs[i] = main_pool.allocate(128);
+		ASSERT_NE(objs[i], nullptr);
+	}
+	std::thread t([&] {
+		counting_pool_type thread_pool;
+		for (size_t i = 0; i < count; i++)
+			thread_pool.deallocate(objs[i]);
+	});
+	t.join();
+
+	// The owner only notices remotely freed chunks during allocation.
+	for (size_t i = 0; i < count / 100; i++)
+		main_pool.deallocate(main_pool.allocate(128));
+	EXPECT_LE(counting_policy::mapped_bytes.load() - baseline, max_retained_bytes);
+}
+
+// Chunks of large size classes have fewer objects than reactivate_threshold.
+// Such chunks must be released even if neither the owner nor remote frees alone
+// free enough objects to make them PENDING.
+TEST(sharded_slab, release_empty_chunks_mixed) {
+	constexpr size_t size = counting_pool_type::policy_traits::max_bucket_size;
+	constexpr size_t count = 1000;
+
+	counting_pool_type main_pool;
+	std::vector<void *> objs(count);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	for (size_t i = 0; i < count; i++) {
+		objs[i] = main_pool.allocate(size);
+		ASSERT_NE(objs[i], nullptr);
+	}
+	// The owner frees every second object and another thread frees the remaining ones last.
+	for (size_t i = 0; i < count; i += 2)
+		main_pool.deallocate(objs[i]);
+	std::thread t([&] {
+		counting_pool_type thread_pool;
+		for (size_t i = 1; i < count; i += 2)
+			thread_pool.deallocate(objs[i]);
+	});
+	t.join();
+
+	// The owner only notices remotely freed chunks during allocation.
+	for (size_t i = 0; i < count; i++)
+		main_pool.deallocate(main_pool.allocate(size));
+	EXPECT_LE(counting_policy::mapped_bytes.load() - baseline, max_retained_bytes);
+}
+
+// Remote frees that are buffered by an otherwise unused size class must reach their chunks
+// once the freeing pool performed remote_free_max_age operations.
+TEST(sharded_slab, remote_free_max_age) {
+	constexpr size_t size = counting_pool_type::policy_traits::max_bucket_size;
+	constexpr size_t count = 16;
+
+	counting_pool_type main_pool;
+	counting_pool_type other_pool;
+	void *objs[count];
+
+	for (size_t i = 0; i < count; i++) {
+		objs[i] = main_pool.allocate(size);
+		ASSERT_NE(objs[i], nullptr);
+	}
+	// Too few frees per chunk to fill a batch; all of them are buffered.
+	for (size_t i = 0; i < count; i++)
+		other_pool.deallocate(objs[i]);
+	for (size_t i = 0; i < counting_pool_type::remote_free_max_age; i++)
+		other_pool.deallocate(other_pool.allocate(128));
+	size_t mapped = counting_policy::mapped_bytes.load();
+
+	// The owner reuses the remotely freed objects instead of mapping new chunks.
+	for (size_t i = 0; i < count; i++) {
+		objs[i] = main_pool.allocate(size);
+		ASSERT_NE(objs[i], nullptr);
+	}
+	EXPECT_EQ(counting_policy::mapped_bytes.load(), mapped);
+	for (size_t i = 0; i < count; i++)
+		main_pool.deallocate(objs[i]);
+}
+
+TEST(sharded_slab, large_cache) {
+	size_t baseline = counting_policy::mapped_bytes.load();
+	{
+		counting_pool_type pool;
+
+		// Allocating and freeing buffers in a loop must reuse the extent.
+		for (size_t i = 0; i < 100; i++) {
+			void *p = pool.allocate(64 << 10);
+			ASSERT_NE(p, nullptr);
+			memset(p, 0xFF, 64 << 10);
+			pool.deallocate(p);
+		}
+		auto stats = pool.large_cache_stats();
+		EXPECT_EQ(stats.misses, 1);
+		EXPECT_EQ(stats.hits, 99);
+
+		// The cache is bounded.
+		std::vector<void *> objs;
+		for (size_t i = 0; i < 64; i++)
+			objs.push_back(pool.allocate(1 << 20));
+		for (auto p : objs)
+			pool.deallocate(p);
+		EXPECT_LE(counting_policy::mapped_bytes.load() - baseline,
+				counting_pool_type::large_cache_bytes + 4 * counting_pool_type::chunk_size);
+	}
+	EXPECT_EQ(counting_policy::mapped_bytes.load(), baseline);
+}
+
+struct remap_policy : counting_policy {
+	static inline size_t num_remaps{0};
+
+	void *remap(void *p, size_t old_size, size_t new_size) {
+		void *q = mremap(p, old_size, new_size, MREMAP_MAYMOVE);
+		if (q == MAP_FAILED)
+			return nullptr;
+		num_remaps++;
+		mapped_bytes += new_size;
+		mapped_bytes -= old_size;
+		return q;
+	}
+};
+
+TEST(sharded_slab, reallocate_remap) {
+	auto check = [] (void *p, size_t size) {
+		for (size_t i = 0; i < size; i++)
+			ASSERT_EQ(static_cast<unsigned char *>(p)[i], 0x42);
+	};
+
+	size_t baseline = counting_policy::mapped_bytes.load();
+	{
+		frg::sharded_slab::pool<remap_policy> pool;
+
+		size_t size = 1 << 20;
+		void *p = pool.allocate(size);
+		ASSERT_NE(p, nullptr);
+		memset(p, 0x42, size);
+		for (int i = 0; i < 4; i++) {
+			p = pool.reallocate(p, 2 * size);
+			ASSERT_NE(p, nullptr);
+			check(p, size);
+			memset(p, 0x42, 2 * size);
+			size *= 2;
+		}
+		EXPECT_EQ(remap_policy::num_remaps, 4);
+		EXPECT_GE(pool.get_size(p), size);
+
+		// Shrinking releases the tail of the extent.
+		p = pool.reallocate(p, 1 << 20);
+		EXPECT_EQ(remap_policy::num_remaps, 5);
+		check(p, 1 << 20);
+		EXPECT_LT(counting_policy::mapped_bytes.load() - baseline, size);
+		pool.deallocate(p);
+	}
+	EXPECT_EQ(counting_policy::mapped_bytes.load(), baseline);
+}
+
+struct arena_policy : sharded_slab_policy {
+	static inline std::atomic<size_t> num_maps{0};
+	static inline std::atomic<size_t> mapped_bytes{0};
+	static inline std::atomic<size_t> committed_bytes{0};
+
+	// Over-allocate and trim to obtain an aligned mapping.
+	void *map(size_t size, size_t alignment) {
+		auto p = sharded_slab_policy::map(size + alignment);
+		if (!p)
+			return nullptr;
+		auto addr = reinterpret_cast<uintptr_t>(p);
+		auto aligned = (addr + alignment - 1) & ~(alignment - 1);
+		if (aligned != addr)
+			munmap(p, aligned - addr);
+		munmap(reinterpret_cast<void *>(aligned + size), addr + alignment - aligned);
+		num_maps++;
+		mapped_bytes += size;
+		return reinterpret_cast<void *>(aligned);
+	}
+
+	void *map(size_t size) {
+		return map(size, 4096);
+	}
+
+	void unmap(void *p, size_t size) {
+		mapped_bytes -= size;
+		sharded_slab_policy::unmap(p, size);
+	}
+
+	void commit(void *, size_t size) {
+		committed_bytes += size;
+	}
+
+	void decommit(void *p, size_t size) {
+		committed_bytes -= size;
+		madvise(p, size, MADV_DONTNEED);
+	}
+};
+
+TEST(sharded_slab, superblock_arena) {
+	using arena_pool_type = frg::sharded_slab::pool<arena_policy>;
+	constexpr size_t count = 200000;
+	constexpr size_t chunk_boundary = arena_pool_type::chunk_boundary;
+
+	std::vector<void *> objs(count);
+	size_t baseline = arena_policy::mapped_bytes.load();
+	{
+		arena_pool_type pool;
+
+		// Chunks are carved out of superblocks that are mapped without over-allocating.
+		for (size_t i = 0; i < count; i++) {
+			objs[i] = pool.allocate(128);
+			ASSERT_NE(objs[i], nullptr);
+			memset(objs[i], 0xFF, 128);
+		}
+		size_t superblocks = (arena_policy::mapped_bytes.load() - baseline)
+				/ arena_pool_type::superblock_size;
+		EXPECT_EQ(arena_policy::mapped_bytes.load() - baseline,
+				superblocks * arena_pool_type::superblock_size);
+		EXPECT_EQ(arena_policy::num_maps.load(), superblocks);
+		EXPECT_GE(arena_policy::committed_bytes.load(), count * 128);
+		EXPECT_LE(arena_policy::committed_bytes.load(),
+				count * 128 + 2 * arena_pool_type::chunk_size);
+
+		// Chunks that are released by another pool are returned to the arena.
+		std::thread t([&] {
+			arena_pool_type thread_pool;
+			for (size_t i = 0; i < count; i++)
+				thread_pool.deallocate(objs[i]);
+		});
+		t.join();
+		for (size_t i = 0; i < count / 100; i++)
+			pool.deallocate(pool.allocate(128));
+		EXPECT_LE(arena_policy::committed_bytes.load(),
+				(arena_pool_type::max_empty_chunks + 1) * arena_pool_type::chunk_size);
+
+		// Large objects are taken from the arena unless they exceed max_arena_extent.
+		auto maps = arena_policy::num_maps.load();
+		for (size_t size : {size_t{1} << 17, size_t{1} << 20, arena_pool_type::max_arena_extent}) {
+			void *p = pool.allocate(size);
+			ASSERT_NE(p, nullptr);
+			memset(p, 0xFF, size);
+			EXPECT_GE(pool.get_size(p), size);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(p) & (chunk_boundary - 1), 0x1000);
+			pool.deallocate(p);
+		}
+		EXPECT_LE(arena_policy::num_maps.load(), maps + 1);
+	}
+	EXPECT_EQ(arena_policy::mapped_bytes.load(), baseline);
+	EXPECT_EQ(arena_policy::committed_bytes.load(), 0);
+}
+
+struct stats_policy : sharded_slab_policy {
+	static constexpr bool enable_stats = true;
+};
+
+TEST(sharded_slab, stats) {
+	using stats_pool_type = frg::sharded_slab::pool<stats_policy>;
+	using traits = frg::slab_policy_traits<stats_policy>;
+	constexpr size_t count = 100;
+	auto idx = traits::size_to_bucket(64);
+
+	stats_pool_type pool;
+	std::vector<void *> objs;
+	for (size_t i = 0; i < count; i++)
+		objs.push_back(pool.allocate(64));
+	void *large = pool.allocate(1 << 20);
+
+	auto stats = pool.snapshot();
+	EXPECT_EQ(stats.buckets[idx].object_size, 64);
+	EXPECT_EQ(stats.buckets[idx].allocations, count);
+	EXPECT_EQ(stats.buckets[idx].slabs_mapped, 1);
+	EXPECT_EQ(stats.buckets[idx].bytes_live, count * 64);
+	EXPECT_EQ(stats.buckets[idx].bytes_resident, count * 64);
+	EXPECT_EQ(stats.large.allocations, 1);
+	EXPECT_GE(stats.large.bytes_live, 1 << 20);
+
+	// Free half of the objects locally and half of them from another pool.
+	for (size_t i = 0; i < count / 2; i++)
+		pool.deallocate(objs[i]);
+	stats_pool_type::stats_type remote_stats;
+	std::thread t{[&] {
+		stats_pool_type thread_pool;
+		for (size_t i = count / 2; i < count; i++)
+			thread_pool.deallocate(objs[i]);
+		thread_pool.deallocate(large);
+		remote_stats = thread_pool.snapshot();
+	}};
+	t.join();
+
+	EXPECT_EQ(remote_stats.buckets[idx].remote_frees, count / 2);
+	EXPECT_EQ(remote_stats.large.frees, 1);
+
+	stats = pool.snapshot();
+	EXPECT_EQ(stats.buckets[idx].frees, count / 2);
+	stats += remote_stats;
+	EXPECT_EQ(stats.buckets[idx].bytes_live, 0);
+	EXPECT_EQ(stats.large.bytes_live, 0);
+}
+
+struct cached_object {
+	static inline std::atomic<size_t> constructions{0};
+	static inline std::atomic<size_t> destructions{0};
+
+	cached_object() {
+		constructions++;
+	}
+
+	~cached_object() {
+		destructions++;
+	}
+
+	void reset() {
+		state = 0;
+	}
+
+	uint64_t state{0};
+	uint64_t payload[8];
+};
+
+TEST(sharded_slab, object_cache) {
+	using stats_pool_type = frg::sharded_slab::pool<stats_policy>;
+	using cache_type = frg::sharded_slab::object_cache<cached_object, stats_policy, 16>;
+	constexpr size_t count = 100;
+	static_assert(cache_type::object_size == sizeof(cached_object));
+
+	stats_pool_type pool;
+	std::vector<cached_object *> objs;
+	{
+		cache_type cache{pool};
+		for (size_t i = 0; i < count; i++) {
+			auto obj = cache.allocate();
+			ASSERT_NE(obj, nullptr);
+			EXPECT_EQ(obj->state, 0);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(obj) % alignof(cached_object), 0);
+			EXPECT_EQ(pool.get_size(obj), sizeof(cached_object));
+			obj->state = i + 1;
+			objs.push_back(obj);
+		}
+		EXPECT_EQ(cached_object::constructions, count);
+
+		// Live bytes are counted in the cache's object size, not in the bucket size.
+		auto idx = frg::slab_policy_traits<stats_policy>::size_to_bucket(sizeof(cached_object));
+		EXPECT_EQ(pool.snapshot().buckets[idx].bytes_live, count * sizeof(cached_object));
+
+		// Freed objects are reset and reused without running constructors or destructors.
+		for (size_t i = 0; i < 16; i++)
+			cache.deallocate(objs[i]);
+		for (size_t i = 0; i < 16; i++) {
+			auto obj = cache.allocate();
+			EXPECT_EQ(obj->state, 0);
+			EXPECT_NE(std::find(objs.begin(), objs.begin() + 16, obj), objs.begin() + 16);
+		}
+		EXPECT_EQ(cached_object::constructions, count);
+		EXPECT_EQ(cached_object::destructions, 0);
+
+		// Objects beyond the capacity of the cache are destructed.
+		for (auto obj : objs)
+			cache.deallocate(obj);
+		EXPECT_EQ(cached_object::destructions, count - 16);
+
+		auto stats = cache.stats();
+		EXPECT_EQ(stats.object_size, sizeof(cached_object));
+		EXPECT_GT(stats.bucket_size, stats.object_size);
+		EXPECT_EQ(stats.allocations, count + 16);
+		EXPECT_EQ(stats.hits, 16);
+		EXPECT_EQ(stats.frees, count + 16);
+		EXPECT_EQ(stats.constructions, count);
+		EXPECT_EQ(stats.destructions, count - 16);
+		EXPECT_EQ(stats.cached, 16);
+	}
+	EXPECT_EQ(cached_object::destructions, count);
+
+	// The cache's objects are accounted to the size class that contains them.
+	auto stats = pool.snapshot();
+	auto idx = frg::slab_policy_traits<stats_policy>::size_to_bucket(sizeof(cached_object));
+	EXPECT_EQ(stats.buckets[idx].allocations, count);
+	EXPECT_EQ(stats.buckets[idx].frees, count);
+	EXPECT_EQ(stats.buckets[idx].bytes_live, 0);
+	EXPECT_EQ(stats.buckets[idx].slabs_mapped, 0);
+}
+
+TEST(sharded_slab, object_cache_orphans) {
+	using cache_type = frg::sharded_slab::object_cache<cached_object, counting_policy>;
+	constexpr size_t count = 50000;
+
+	std::vector<cached_object *> objs(count);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	// Allocate from a cache whose pool is destroyed while objects are still live.
+	std::thread t([&] {
+		counting_pool_type thread_pool;
+		cache_type cache{thread_pool};
+		for (size_t i = 0; i < count; i++) {
+			objs[i] = cache.allocate();
+			ASSERT_NE(objs[i], nullptr);
+		}
+	});
+	t.join();
+	EXPECT_GT(counting_policy::mapped_bytes.load() - baseline, count * sizeof(cached_object));
+
+	{
+		counting_pool_type pool;
+		{
+			cache_type cache{pool};
+			for (size_t i = 0; i < count; i++)
+				cache.deallocate(objs[i]);
+		}
+		pool.flush();
+
+		// A new cache of the same type adopts and releases the orphaned chunks.
+		cache_type cache{pool};
+		cache.deallocate(cache.allocate());
+	}
+	EXPECT_EQ(counting_policy::mapped_bytes.load(), baseline);
+}
+
+TEST(sharded_slab, flush_remote_frees) {
+	constexpr size_t count = 200000;
+
+	counting_pool_type main_pool;
+	counting_pool_type thread_pool;
+	std::vector<void *> objs(count);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	for (size_t i = 0; i < count; i++) {
+		objs[i] = main_pool.allocate(128);
+		ASSERT_NE(objs[i], nullptr);
+	}
+	// Interleave the chunks such that remote frees are evicted from the buffer.
+	std::thread t([&] {
+		for (size_t i = 0; i < count / 2; i++) {
+			thread_pool.deallocate(objs[i]);
+			thread_pool.deallocate(objs[count - i - 1]);
+		}
+	});
+	t.join();
+	thread_pool.flush();
+
+	for (size_t i = 0; i < count / 100; i++)
+		main_pool.deallocate(main_pool.allocate(128));
+	EXPECT_LE(counting_policy::mapped_bytes.load() - baseline, max_retained_bytes);
+}
+
+TEST(sharded_slab, orphan_adoption) {
+	constexpr size_t count = 100000;
+
+	counting_pool_type main_pool;
+	std::vector<void *> objs(count);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	// Allocate from a pool that is destroyed while objects are still live.
+	// Free every second object such that the orphaned chunks are partially free.
+	std::thread t([&] {
+		counting_pool_type thread_pool;
+		for (size_t i = 0; i < count; i++) {
+			objs[i] = thread_pool.allocate(128);
+			ASSERT_NE(objs[i], nullptr);
+		}
+		for (size_t i = 0; i < count; i += 2)
+			thread_pool.deallocate(objs[i]);
+	});
+	t.join();
+	size_t orphaned_bytes = counting_policy::mapped_bytes.load() - baseline;
+	EXPECT_GT(orphaned_bytes, count / 2 * 128);
+
+	// Allocating from the main pool must reuse the orphaned chunks.
+	for (size_t i = 0; i < count; i += 2) {
+		objs[i] = main_pool.allocate(128);
+		ASSERT_NE(objs[i], nullptr);
+	}
+	EXPECT_LE(counting_policy::mapped_bytes.load() - baseline, orphaned_bytes);
+
+	// Once all objects are freed, the adopted chunks must be released.
+	for (size_t i = 0; i < count; i++)
+		main_pool.deallocate(objs[i]);
+	for (size_t i = 0; i < count / 100; i++)
+		main_pool.deallocate(main_pool.allocate(128));
+	EXPECT_LE(counting_policy::mapped_bytes.load() - baseline, max_retained_bytes);
+}
+
+TEST(sharded_slab, orphan_release) {
+	constexpr size_t count = 100000;
+	constexpr size_t num_threads = 4;
+
+	std::vector<void *> objs(count * num_threads);
+	size_t baseline = counting_policy::mapped_bytes.load();
+
+	// Threads allocate objects and exit, the objects are freed by other threads afterwards.
+	for (size_t j = 0; j < num_threads; j++) {
+		std::thread t([&, j] {
+			counting_pool_type thread_pool;
+			for (size_t i = j; i < count * num_threads; i += num_threads) {
+				thread_pool.deallocate(objs[i]);
+				objs[i] = nullptr;
+			}
+			for (size_t i = 0; i < count; i++) {
+				objs[j * count + i] = thread_pool.allocate(128);
+				ASSERT_NE(objs[j * count + i], nullptr);
+			}
+		});
+		t.join();
+	}
+
+	{
+		counting_pool_type pool;
+		for (size_t i = 0; i < count * num_threads; i++)
+			pool.deallocate(objs[i]);
+		pool.deallocate(pool.allocate(128));
+	}
+	EXPECT_EQ(counting_policy::mapped_bytes.load(), baseline);
+}
+
 struct poison_policy : sharded_slab_policy {
 	static inline std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
 
@@ -239,6 +881,136 @@ TEST(sharded_slab, poisoning) {
 	EXPECT_FALSE(exact_match);
 }
 
+struct guarded_policy : sharded_slab_policy {
+	static constexpr size_t guarded_sample_interval = 1;
+
+	void protect(void *p, size_t size) {
+		mprotect(p, size, PROT_NONE);
+	}
+
+	void unprotect(void *p, size_t size) {
+		mprotect(p, size, PROT_READ | PROT_WRITE);
+	}
+
+	template<typename F>
+	void walk_stack(F fn) {
+		fn(0x1234);
+	}
+};
+
+TEST(sharded_slab, guarded_sampling) {
+	using guarded_pool_type = frg::sharded_slab::pool<guarded_policy>;
+	constexpr size_t page_size = guarded_pool_type::page_size;
+	guarded_pool_type pool;
+
+	// With an interval of one, all allocations after the first are sampled.
+	pool.deallocate(pool.allocate(64));
+	auto p = static_cast<char *>(pool.allocate(64));
+	ASSERT_NE(p, nullptr);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % 64, 0);
+	EXPECT_EQ(reinterpret_cast<uintptr_t>(p + pool.get_size(p)) % page_size, 0);
+	memset(p, 0xFF, pool.get_size(p));
+
+	frg::sharded_slab::guarded_report report;
+	ASSERT_TRUE(guarded_pool_type::explain_guarded_fault(p + pool.get_size(p), report));
+	EXPECT_EQ(report.error, frg::sharded_slab::guarded_error::buffer_overflow);
+	EXPECT_EQ(report.object, p);
+	EXPECT_EQ(report.size, 64);
+	EXPECT_EQ(report.allocation_depth, 1);
+	EXPECT_EQ(report.allocation_trace[0], 0x1234);
+	EXPECT_FALSE(guarded_pool_type::explain_guarded_fault(&report, report));
+
+	EXPECT_DEATH(p[pool.get_size(p)] = 0, "");
+
+	// Freed objects are quarantined: the next sample uses a different page.
+	pool.deallocate(p);
+	EXPECT_DEATH(p[0] = 0, "");
+	ASSERT_TRUE(guarded_pool_type::explain_guarded_fault(p, report));
+	EXPECT_EQ(report.error, frg::sharded_slab::guarded_error::use_after_free);
+	EXPECT_EQ(report.deallocation_depth, 1);
+
+	auto q = static_cast<char *>(pool.allocate(100));
+	ASSERT_NE(q, nullptr);
+	EXPECT_NE(reinterpret_cast<uintptr_t>(q) / page_size, reinterpret_cast<uintptr_t>(p) / page_size);
+
+	// Some objects are placed at the start of their page to catch underflows.
+	std::vector<char *> samples;
+	char *left = nullptr;
+	for (size_t i = 0; i < 20 && !left; i++) {
+		auto sample = static_cast<char *>(pool.allocate(64));
+		ASSERT_NE(sample, nullptr);
+		samples.push_back(sample);
+		if (!(reinterpret_cast<uintptr_t>(sample) % page_size))
+			left = sample;
+	}
+	ASSERT_NE(left, nullptr);
+	EXPECT_DEATH(left[-1] = 0, "");
+	ASSERT_TRUE(guarded_pool_type::explain_guarded_fault(left - 1, report));
+	EXPECT_EQ(report.error, frg::sharded_slab::guarded_error::buffer_underflow);
+	EXPECT_EQ(report.object, left);
+	for (auto sample : samples)
+		pool.deallocate(sample);
+
+	// Guarded objects move on reallocation.
+	memset(q, 0x42, 100);
+	auto r = static_cast<char *>(pool.reallocate(q, 200));
+	ASSERT_NE(r, nullptr);
+	EXPECT_NE(r, q);
+	for (size_t i = 0; i < 100; i++)
+		ASSERT_EQ(r[i], 0x42);
+	pool.deallocate(r);
+
+	// Once all slots are in use, allocations fall back to slabs.
+	std::vector<void *> objs;
+	for (size_t i = 0; i < 100; i++) {
+		objs.push_back(pool.allocate(32));
+		ASSERT_NE(objs.back(), nullptr);
+		memset(objs.back(), 0xFF, 32);
+	}
+	size_t guarded = std::count_if(objs.begin(), objs.end(), [&] (void *obj) {
+		return guarded_pool_type::explain_guarded_fault(obj, report);
+	});
+	EXPECT_GT(guarded, 0);
+	EXPECT_LT(guarded, objs.size());
+	for (auto obj : objs)
+		pool.deallocate(obj);
+}
+
+struct sampled_guarded_policy : guarded_policy {
+	static constexpr size_t guarded_sample_interval = 100;
+};
+
+TEST(sharded_slab, guarded_sample_interval) {
+	using guarded_pool_type = frg::sharded_slab::pool<sampled_guarded_policy>;
+	constexpr size_t count = 10000;
+	guarded_pool_type pool;
+
+	size_t guarded = 0;
+	frg::sharded_slab::guarded_report report;
+	for (size_t i = 0; i < count; i++) {
+		void *p = pool.allocate(48);
+		ASSERT_NE(p, nullptr);
+		if (guarded_pool_type::explain_guarded_fault(p, report))
+			guarded++;
+		pool.deallocate(p);
+	}
+	EXPECT_GT(guarded, count / 100 / 2);
+	EXPECT_LT(guarded, count / 100 * 2);
+}
+
+TEST(sharded_slab, lazy_carving) {
+	frg::sharded_slab::pool<poison_policy> pool;
+	poison_policy::ranges.clear();
+
+	// Creating a chunk must not touch objects other than the allocated one.
+	void *p = pool.allocate(16);
+	auto address = reinterpret_cast<uintptr_t>(p);
+	for (const auto &r : poison_policy::ranges)
+		EXPECT_TRUE(r.second <= address || r.first == address);
+	EXPECT_LE(poison_policy::ranges.size(), 2);
+	pool.deallocate(p);
+}
+
 struct trace_policy : sharded_slab_policy {
 	static inline std::vector<uint8_t> buffer;
 
@@ -295,3 +1067,266 @@ TEST(sharded_slab, tracing) {
 	memcpy(&word, &trace_policy::buffer[17], 8);
 	EXPECT_EQ(word, 0xA5A5A5A5A5A5A5A5ULL);
 }
+
+struct sampled_trace_policy : sharded_slab_policy {
+	static constexpr size_t trace_sample_interval = 1 << 16;
+
+	static inline std::vector<uint8_t> buffer;
+
+	bool enable_trace() { return true; }
+
+	void output_trace(void *buf, size_t size) {
+		const uint8_t *b = static_cast<const uint8_t *>(buf);
+		buffer.insert(buffer.end(), b, b + size);
+	}
+
+	template<typename F>
+	void walk_stack(F fn) {
+		fn(0x1234);
+	}
+};
+
+TEST(sharded_slab, sampled_tracing) {
+	constexpr size_t count = 10000;
+	constexpr size_t size = 128;
+
+	// Returns the records of each type; words of a record are stored after its type.
+	auto parse = [] {
+		std::map<char, std::vector<std::vector<uint64_t>>> records;
+		size_t i = 0;
+		while (i < sampled_trace_policy::buffer.size()) {
+			char c = sampled_trace_policy::buffer[i++];
+			std::vector<uint64_t> words;
+			while (true) {
+				uint64_t word;
+				memcpy(&word, &sampled_trace_policy::buffer[i], 8);
+				i += 8;
+				if (word == 0xA5A5A5A5A5A5A5A5ULL)
+					break;
+				words.push_back(word);
+			}
+			records[c].push_back(words);
+		}
+		return records;
+	};
+
+	frg::sharded_slab::pool<sampled_trace_policy> pool;
+	std::vector<void *> objs;
+	for (size_t i = 0; i < count; i++)
+		objs.push_back(pool.allocate(size));
+
+	// The interval is recorded once, before the first sampled allocation.
+	auto records = parse();
+	ASSERT_EQ(records['i'].size(), 1);
+	EXPECT_EQ(sampled_trace_policy::buffer[0], 'i');
+	EXPECT_EQ(records['i'][0][0], sampled_trace_policy::trace_sample_interval);
+
+	// On average, count * size / interval (~20) allocations are sampled.
+	auto num_sampled = records['a'].size();
+	EXPECT_GE(num_sampled, 5);
+	EXPECT_LE(num_sampled, 60);
+	for (auto &r : records['a']) {
+		EXPECT_NE(std::find(objs.begin(), objs.end(), reinterpret_cast<void *>(r[0])), objs.end());
+		EXPECT_EQ(r[1], size);
+	}
+
+	// Only frees of sampled objects are recorded.
+	for (auto p : objs)
+		pool.deallocate(p);
+	records = parse();
+	ASSERT_EQ(records['f'].size(), num_sampled);
+	for (size_t k = 0; k < num_sampled; k++)
+		EXPECT_EQ(records['f'][k][0], records['a'][k][0]);
+}
+
+struct trace_v2_policy : trace_policy {
+	static constexpr int trace_version = 2;
+
+	static inline std::vector<uint8_t> buffer;
+
+	void output_trace(void *buf, size_t size) {
+		const uint8_t *b = static_cast<const uint8_t *>(buf);
+		buffer.insert(buffer.end(), b, b + size);
+	}
+};
+
+TEST(sharded_slab, tracing_v2) {
+	constexpr size_t count = 1000;
+
+	size_t i = 0;
+	auto read_varint = [&] {
+		uint64_t val = 0;
+		for (int shift = 0;; shift += 7) {
+			uint8_t byte = trace_v2_policy::buffer.at(i++);
+			val |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return val;
+		}
+	};
+	auto read_delta = [&] (uint64_t prev) {
+		uint64_t zigzag = read_varint();
+		return prev + ((zigzag >> 1) ^ -(zigzag & 1));
+	};
+
+	frg::sharded_slab::pool<trace_v2_policy> pool;
+	void *p = pool.allocate(128);
+	void *q = pool.allocate(128);
+	pool.deallocate(p);
+
+	// Header.
+	ASSERT_GE(trace_v2_policy::buffer.size(), 5);
+	EXPECT_EQ(memcmp(trace_v2_policy::buffer.data(), "FRGT", 4), 0);
+	i = 4;
+	EXPECT_EQ(read_varint(), 2);
+
+	// The first record writes the stack with id 1.
+	EXPECT_EQ(trace_v2_policy::buffer.at(i++), 'a');
+	EXPECT_EQ(read_delta(0), reinterpret_cast<uintptr_t>(p));
+	EXPECT_EQ(read_varint(), 128);
+	EXPECT_EQ(read_varint(), (1 << 1) | 1);
+	EXPECT_EQ(read_varint(), 1);
+	EXPECT_EQ(read_delta(0), 0x1234);
+
+	// The following records only refer to the stack.
+	EXPECT_EQ(trace_v2_policy::buffer.at(i++), 'a');
+	EXPECT_EQ(read_delta(reinterpret_cast<uintptr_t>(p)), reinterpret_cast<uintptr_t>(q));
+	EXPECT_EQ(read_varint(), 128);
+	EXPECT_EQ(read_varint(), 1 << 1);
+
+	EXPECT_EQ(trace_v2_policy::buffer.at(i++), 'f');
+	EXPECT_EQ(read_delta(reinterpret_cast<uintptr_t>(q)), reinterpret_cast<uintptr_t>(p));
+	EXPECT_EQ(read_varint(), 1 << 1);
+	EXPECT_EQ(i, trace_v2_policy::buffer.size());
+	pool.deallocate(q);
+
+	// Compare the size of the trace to version 1.
+	trace_policy::buffer.clear();
+	trace_v2_policy::buffer.clear();
+	frg::sharded_slab::pool<trace_policy> pool_v1;
+	std::vector<void *> objs;
+	for (size_t k = 0; k < count; k++) {
+		objs.push_back(pool.allocate(64));
+		pool_v1.deallocate(pool_v1.allocate(64));
+	}
+	for (auto obj : objs)
+		pool.deallocate(obj);
+	EXPECT_EQ(trace_policy::buffer.size(), count * (33 + 25));
+	EXPECT_LE(trace_v2_policy::buffer.size() * 5, trace_policy::buffer.size());
+}
+
+TEST(sharded_slab, tracing_v2_threads) {
+	frg::sharded_slab::pool<trace_v2_policy> pool;
+	void *p = pool.allocate(32);
+	trace_v2_policy::buffer.clear();
+
+	std::thread thread{[] {
+		frg::sharded_slab::pool<trace_v2_policy> other;
+		other.deallocate(other.allocate(32));
+	}};
+	thread.join();
+	pool.deallocate(p);
+
+	// Decode the record types and the thread of each record.
+	size_t i = 0;
+	auto read_varint = [&] {
+		uint64_t val = 0;
+		for (int shift = 0;; shift += 7) {
+			uint8_t byte = trace_v2_policy::buffer.at(i++);
+			val |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return val;
+		}
+	};
+
+	uint64_t current = 0;
+	std::vector<std::pair<char, uint64_t>> records;
+	while (i < trace_v2_policy::buffer.size()) {
+		char c = trace_v2_policy::buffer.at(i++);
+		if (c == 't') {
+			current = read_varint();
+			continue;
+		}
+		read_varint();
+		if (c == 'a')
+			read_varint();
+		if (read_varint() & 1) {
+			for (uint64_t n = read_varint(); n; n--)
+				read_varint();
+		}
+		records.push_back({c, current});
+	}
+
+	ASSERT_EQ(records.size(), 3);
+	EXPECT_EQ(trace_v2_policy::buffer.at(0), 't');
+	EXPECT_EQ(records[0].first, 'a');
+	EXPECT_NE(records[0].second, 0);
+	EXPECT_EQ(records[1].first, 'f');
+	EXPECT_EQ(records[1].second, records[0].second);
+	// The main thread emitted the first record of this policy.
+	EXPECT_EQ(records[2].first, 'f');
+	EXPECT_EQ(records[2].second, 0);
+}
+
+struct trace_v2_collision_policy : trace_v2_policy { };
+
+// Distinct stacks with the same hash must not be interned with the same id.
+TEST(sharded_slab, tracing_v2_collision) {
+	using encoder = frg::slab::trace_encoder_v2<trace_v2_collision_policy>;
+
+	auto hash = [] (const uintptr_t *frames, size_t num_frames) {
+		uint64_t h = num_frames;
+		for (size_t i = 0; i < num_frames; i++)
+			h = (h ^ frames[i]) * 0x100000001B3ULL;
+		return h;
+	};
+
+	// Choose the last frame of b such that both stacks have the same hash.
+	uintptr_t a[2] = {0x1000, 0x2000};
+	uintptr_t b[2] = {0x3000, 0};
+	b[1] = hash(a, 1) ^ a[1] ^ hash(b, 1);
+	ASSERT_EQ(hash(a, 2), hash(b, 2));
+
+	trace_v2_collision_policy policy;
+	trace_v2_policy::buffer.clear();
+	encoder::emit(policy, 'f', 0, 0, a, 2);
+	encoder::emit(policy, 'f', 0, 0, b, 2);
+	encoder::emit(policy, 'f', 0, 0, a, 2);
+
+	size_t i = 0;
+	auto read_varint = [&] {
+		uint64_t val = 0;
+		for (int shift = 0;; shift += 7) {
+			uint8_t byte = trace_v2_policy::buffer.at(i++);
+			val |= uint64_t(byte & 0x7F) << shift;
+			if (!(byte & 0x80))
+				return val;
+		}
+	};
+	auto read_stack = [&] {
+		EXPECT_EQ(trace_v2_policy::buffer.at(i++), 'f');
+		EXPECT_EQ(read_varint(), 0);
+		auto ref = read_varint();
+		std::vector<uintptr_t> frames;
+		if (ref & 1) {
+			uint64_t prev = 0;
+			for (uint64_t n = read_varint(); n; n--) {
+				uint64_t zigzag = read_varint();
+				prev += (zigzag >> 1) ^ -(zigzag & 1);
+				frames.push_back(prev);
+			}
+		}
+		return std::make_pair(ref, frames);
+	};
+
+	i = 5;
+	auto [ref_a, frames_a] = read_stack();
+	EXPECT_EQ(ref_a, (1 << 1) | 1);
+	EXPECT_EQ(frames_a, std::vector<uintptr_t>(a, a + 2));
+	// The colliding stack is written in full without an id.
+	auto [ref_b, frames_b] = read_stack();
+	EXPECT_EQ(ref_b, 1);
+	EXPECT_EQ(frames_b, std::vector<uintptr_t>(b, b + 2));
+	auto [ref_a2, frames_a2] = read_stack();
+	EXPECT_EQ(ref_a2, 1 << 1);
+	EXPECT_EQ(i, trace_v2_policy::buffer.size());
+}
@@ -0,0 +1,587 @@
+#include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/mman.h>
+#include <thread>
+#include <vector>
+
+#include <frg/slab.hpp>
+#include <gtest/gtest.h>
+
+struct slab_policy {
+	static inline std::atomic<size_t> mapped_bytes{0};
+
+	uintptr_t map(size_t size) {
+		void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+		               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return 0;
+		mapped_bytes += size;
+		return reinterpret_cast<uintptr_t>(p);
+	}
+
+	void unmap(uintptr_t p, size_t size) {
+		mapped_bytes -= size;
+		munmap(reinterpret_cast<void *>(p), size);
+	}
+};
+
+using slab_pool_type = frg::slab_pool<slab_policy, std::mutex>;
+
+// Check all powers of two from 2^0 to 2^24 to check whether all size classes and large allocations work.
+TEST(slab, multiple_sizes) {
+	slab_policy policy;
+	slab_pool_type pool{policy};
+
+	for (int s = 0; s <= 24; s++) {
+		size_t size = size_t{1} << s;
+		void *obj = pool.allocate(size);
+		ASSERT_NE(obj, nullptr);
+		memset(obj, 0xFF, size);
+		EXPECT_GE(pool.get_size(obj), size);
+		pool.free(obj);
+	}
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+}
+
+TEST(slab, allocate_aligned) {
+	slab_policy policy;
+	slab_pool_type pool{policy};
+
+	for (int a = 0; a <= 18; a++) {
+		size_t alignment = size_t{1} << a;
+		for (size_t size : {size_t{1}, size_t{24}, size_t{100}, size_t{5000}, size_t{100000}}) {
+			void *p = pool.allocate_aligned(size, alignment);
+			ASSERT_NE(p, nullptr);
+			EXPECT_EQ(reinterpret_cast<uintptr_t>(p) & (alignment - 1), 0);
+			EXPECT_GE(pool.get_size(p), size);
+			memset(p, 0xFF, size);
+			pool.deallocate(p, size);
+		}
+	}
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+}
+
+struct fine_slab_policy : slab_policy {
+	static constexpr unsigned int small_step_exp = 2;
+};
+
+TEST(slab, size_classes) {
+	using traits = frg::slab_policy_traits<fine_slab_policy>;
+	static_assert(traits::bucket_to_size(4) == 80);
+	static_assert(traits::max_bucket_size == 32768);
+
+	fine_slab_policy policy;
+	frg::slab_pool<fine_slab_policy, std::mutex> pool{policy};
+
+	// Above 64 bytes, the internal fragmentation is at most 25%.
+	for (size_t size = 1; size <= traits::max_bucket_size; size += 7) {
+		void *p = pool.allocate(size);
+		ASSERT_NE(p, nullptr);
+		memset(p, 0xFF, size);
+		EXPECT_GE(pool.get_size(p), size);
+		if (size > 64) {
+			EXPECT_LE(pool.get_size(p), size + size / 4);
+		}
+		EXPECT_EQ(pool.get_size(p), traits::bucket_to_size(traits::size_to_bucket(size)));
+		pool.free(p);
+	}
+	void *p = pool.allocate(65);
+	EXPECT_EQ(pool.get_size(p), 80);
+	pool.free(p);
+
+	// Objects must not extend beyond the end of their (sb_size aligned) slab,
+	// even if the slab size is not a multiple of the object size.
+	std::vector<void *> objs(10000);
+	for (auto &obj : objs) {
+		obj = pool.allocate(80);
+		ASSERT_NE(obj, nullptr);
+		EXPECT_LE((reinterpret_cast<uintptr_t>(obj) & ((1 << 18) - 1)) + 80, 1 << 18);
+	}
+	for (auto obj : objs)
+		pool.free(obj);
+	pool.purge();
+}
+
+TEST(slab, release_empty_slabs) {
+	constexpr size_t count = 20000;
+
+	slab_policy policy;
+	slab_pool_type pool{policy};
+	std::vector<void *> objs(count);
+	size_t baseline = slab_policy::mapped_bytes.load();
+
+	for (size_t i = 0; i < 3; ++i) {
+		for (size_t i = 0; i < count; i++) {
+			objs[i] = pool.allocate(128);
+			ASSERT_NE(objs[i], nullptr);
+			memset(objs[i], 0xFF, 128);
+		}
+		EXPECT_GE(pool.numUsedPages() * 0x1000, count * 128);
+
+		for (size_t i = 0; i < count; i++)
+			pool.free(objs[i]);
+
+		// At most one empty slab (the default of max_empty_slabs) stays cached.
+		EXPECT_LE(pool.numUsedPages() * 0x1000, 2 * (1 << 18));
+		EXPECT_LE(slab_policy::mapped_bytes.load() - baseline, 2 * (1 << 18));
+	}
+
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+	EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+}
+
+TEST(slab, large_cache) {
+	slab_policy policy;
+	slab_pool_type pool{policy};
+	size_t baseline = slab_policy::mapped_bytes.load();
+
+	// Allocating and freeing buffers in a loop must reuse the extent.
+	for (size_t i = 0; i < 100; i++) {
+		void *p = pool.allocate(64 << 10);
+		ASSERT_NE(p, nullptr);
+		memset(p, 0xFF, 64 << 10);
+		pool.free(p);
+	}
+	auto stats = pool.large_cache_stats();
+	EXPECT_EQ(stats.misses, 1);
+	EXPECT_EQ(stats.hits, 99);
+	EXPECT_EQ(pool.numUsedPages(), 0);
+
+	// Extents that were not reused for a while are released.
+	for (size_t i = 0; i < 1000; i++)
+		pool.free(pool.allocate(512 << 10));
+	EXPECT_LE(slab_policy::mapped_bytes.load() - baseline, 2 * ((512 << 10) + 2 * (1 << 18)));
+
+	pool.purge();
+	EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+}
+
+struct remap_slab_policy : slab_policy {
+	static inline size_t num_remaps{0};
+
+	uintptr_t remap(uintptr_t p, size_t old_size, size_t new_size) {
+		void *q = mremap(reinterpret_cast<void *>(p), old_size, new_size, MREMAP_MAYMOVE);
+		if (q == MAP_FAILED)
+			return 0;
+		num_remaps++;
+		mapped_bytes += new_size;
+		mapped_bytes -= old_size;
+		return reinterpret_cast<uintptr_t>(q);
+	}
+};
+
+TEST(slab, reallocate_large) {
+	auto check = [] (void *p, size_t size) {
+		for (size_t i = 0; i < size; i++)
+			ASSERT_EQ(static_cast<unsigned char *>(p)[i], 0x42);
+	};
+
+	// Without Policy::remap(), large objects grow into the slack of their extent.
+	{
+		slab_policy policy;
+		slab_pool_type pool{policy};
+		size_t baseline = slab_policy::mapped_bytes.load();
+
+		pool.free(pool.allocate(768 << 10));
+		void *p = pool.allocate(512 << 10);
+		ASSERT_NE(p, nullptr);
+		memset(p, 0x42, 512 << 10);
+		EXPECT_EQ(pool.realloc(p, 768 << 10), p);
+		EXPECT_GE(pool.get_size(p), 768 << 10);
+		check(p, 512 << 10);
+		pool.free(p);
+
+		pool.purge();
+		EXPECT_EQ(pool.numUsedPages(), 0);
+		EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+	}
+
+	// With Policy::remap(), growing and shrinking does not allocate a new frame.
+	{
+		remap_slab_policy policy;
+		frg::slab_pool<remap_slab_policy, std::mutex> pool{policy};
+		size_t baseline = slab_policy::mapped_bytes.load();
+		remap_slab_policy::num_remaps = 0;
+
+		size_t size = 1 << 20;
+		void *p = pool.allocate(size);
+		ASSERT_NE(p, nullptr);
+		memset(p, 0x42, size);
+		for (int i = 0; i < 4; i++) {
+			p = pool.realloc(p, 2 * size);
+			ASSERT_NE(p, nullptr);
+			check(p, size);
+			memset(p, 0x42, 2 * size);
+			size *= 2;
+		}
+		EXPECT_EQ(remap_slab_policy::num_remaps, 4);
+		EXPECT_GE(pool.get_size(p), size);
+
+		p = pool.realloc(p, 1 << 20);
+		EXPECT_EQ(remap_slab_policy::num_remaps, 5);
+		check(p, 1 << 20);
+		EXPECT_LT(slab_policy::mapped_bytes.load() - baseline, size);
+		pool.free(p);
+
+		pool.purge();
+		EXPECT_EQ(pool.numUsedPages(), 0);
+		EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+	}
+}
+
+struct stats_slab_policy : slab_policy {
+	static constexpr bool enable_stats = true;
+};
+
+TEST(slab, stats) {
+	using traits = frg::slab_policy_traits<stats_slab_policy>;
+	constexpr size_t count = 100;
+
+	stats_slab_policy policy;
+	frg::slab_pool<stats_slab_policy, std::mutex> pool{policy};
+
+	// Take snapshots concurrently to allocations.
+	std::atomic<bool> done{false};
+	std::thread monitor{[&] {
+		uint64_t last = 0;
+		while (!done.load()) {
+			auto stats = pool.snapshot();
+			auto &b = stats.buckets[traits::size_to_bucket(64)];
+			EXPECT_GE(b.allocations, last);
+			EXPECT_GE(b.allocations, b.frees);
+			last = b.allocations;
+		}
+	}};
+
+	std::vector<void *> objs;
+	for (size_t i = 0; i < count; i++)
+		objs.push_back(pool.allocate(64));
+	void *large = pool.allocate(1 << 20);
+
+	auto stats = pool.snapshot();
+	auto &b = stats.buckets[traits::size_to_bucket(64)];
+	EXPECT_EQ(b.object_size, 64);
+	EXPECT_EQ(b.allocations, count);
+	EXPECT_EQ(b.frees, 0);
+	EXPECT_EQ(b.slabs_mapped, 1);
+	EXPECT_EQ(b.bytes_live, count * 64);
+	EXPECT_EQ(b.bytes_resident, count * 64);
+	EXPECT_EQ(stats.large.allocations, 1);
+	EXPECT_EQ(stats.large.bytes_live, 1 << 20);
+
+	for (auto p : objs)
+		pool.free(p);
+	pool.free(large);
+
+	stats = pool.snapshot();
+	EXPECT_EQ(b.frees, count);
+	EXPECT_EQ(b.bytes_live, 0);
+	EXPECT_EQ(stats.large.frees, 1);
+	EXPECT_EQ(stats.large.bytes_live, 0);
+
+	pool.purge();
+	stats = pool.snapshot();
+	EXPECT_EQ(b.slabs_mapped, 0);
+	EXPECT_EQ(b.bytes_resident, 0);
+
+	done.store(true);
+	monitor.join();
+}
+
+// Mutex that counts how often each instance is locked.
+struct counting_mutex {
+	static inline std::mutex counts_mutex;
+	static inline std::map<counting_mutex *, size_t> counts;
+
+	void lock() {
+		mutex.lock();
+		std::lock_guard guard{counts_mutex};
+		counts[this]++;
+	}
+
+	void unlock() {
+		mutex.unlock();
+	}
+
+	std::mutex mutex;
+};
+
+struct cpu_slab_policy : slab_policy {
+	static constexpr size_t max_cpus = 4;
+	static constexpr size_t magazine_size = 16;
+
+	static inline std::atomic<size_t> next_cpu{0};
+
+	size_t cpu_index() {
+		thread_local size_t cpu = next_cpu++ % max_cpus;
+		return cpu;
+	}
+};
+
+using cpu_slab_pool_type = frg::slab_pool<cpu_slab_policy, counting_mutex>;
+
+TEST(slab, magazines) {
+	constexpr size_t count = 1000;
+	constexpr size_t rounds = 100;
+
+	cpu_slab_policy policy;
+	auto pool = std::make_unique<cpu_slab_pool_type>(policy);
+	std::vector<void *> objs(count);
+	size_t baseline = slab_policy::mapped_bytes.load();
+
+	auto run = [&] {
+		for (size_t r = 0; r < rounds; r++) {
+			for (size_t i = 0; i < count; i++) {
+				objs[i] = pool->allocate(64);
+				ASSERT_NE(objs[i], nullptr);
+				memset(objs[i], 0xFF, 64);
+			}
+			for (size_t i = 0; i < count; i++)
+				pool->free(objs[i]);
+		}
+	};
+
+	// Objects are cached in magazines of the CPU that freed them.
+	std::thread t1{run};
+	t1.join();
+	std::thread t2{run};
+	t2.join();
+
+	// The per-CPU mutexes of the two threads are taken on every operation.
+	// Without magazines, the bucket mutex would also be taken 4 * rounds * count times.
+	// With magazines, it is only taken when magazines are exchanged with the depot.
+	std::vector<size_t> counts;
+	for (auto [mutex, n] : counting_mutex::counts)
+		counts.push_back(n);
+	std::sort(counts.begin(), counts.end(), std::greater<>{});
+	ASSERT_GE(counts.size(), 3);
+	EXPECT_GE(counts[1], 2 * rounds * count);
+	EXPECT_LE(counts[2], 4 * rounds * count / (cpu_slab_policy::magazine_size / 2));
+
+	pool->purge();
+	EXPECT_EQ(pool->numUsedPages(), 0);
+	EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+}
+
+struct lock_free_slab_policy : slab_policy {
+	static constexpr bool lock_free_buckets = true;
+};
+
+TEST(slab, lock_free_buckets) {
+	constexpr size_t count = 1000;
+	constexpr size_t rounds = 100;
+
+	lock_free_slab_policy policy;
+	auto pool = std::make_unique<frg::slab_pool<lock_free_slab_policy, counting_mutex>>(policy);
+	std::vector<void *> objs(count);
+	size_t baseline = slab_policy::mapped_bytes.load();
+	counting_mutex::counts.clear();
+
+	for (size_t r = 0; r < rounds; r++) {
+		for (size_t i = 0; i < count; i++) {
+			objs[i] = pool->allocate(64);
+			ASSERT_NE(objs[i], nullptr);
+			memset(objs[i], 0xFF, 64);
+		}
+		for (size_t i = 0; i < count; i++)
+			pool->free(objs[i]);
+	}
+
+	// All objects fit into the active slab, so frees never take the bucket mutex
+	// and allocations only take it to reserve a batch of objects.
+	for (auto [mutex, n] : counting_mutex::counts)
+		EXPECT_LE(n, rounds * count / 16);
+
+	pool->purge();
+	EXPECT_EQ(pool->numUsedPages(), 0);
+	EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+}
+
+TEST(slab, lock_free_buckets_threads) {
+	constexpr size_t num_threads = 4;
+	constexpr size_t count = 20000;
+	constexpr size_t rounds = 20;
+
+	lock_free_slab_policy policy;
+	frg::slab_pool<lock_free_slab_policy, std::mutex> pool{policy};
+	size_t baseline = slab_policy::mapped_bytes.load();
+
+	// Each thread frees the objects of the previous thread, such that slabs become
+	// full, partial and empty while other threads allocate from them.
+	std::vector<std::vector<unsigned char *>> objs(num_threads);
+	std::barrier barrier(num_threads);
+
+	auto run = [&] (size_t t) {
+		for (size_t r = 0; r < rounds; r++) {
+			auto &mine = objs[(t + r) % num_threads];
+			for (size_t i = 0; i < mine.size(); i++) {
+				size_t size = 16 << (i % 3);
+				for (size_t k = 0; k < size; k++)
+					ASSERT_EQ(mine[i][k], static_cast<unsigned char>(i));
+				pool.free(mine[i]);
+			}
+			mine.clear();
+			for (size_t i = 0; i < count; i++) {
+				size_t size = 16 << (i % 3);
+				auto p = static_cast<unsigned char *>(pool.allocate(size));
+				ASSERT_NE(p, nullptr);
+				memset(p, static_cast<unsigned char>(i), size);
+				mine.push_back(p);
+			}
+			barrier.arrive_and_wait();
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < num_threads; t++)
+		threads.emplace_back(run, t);
+	for (auto &thread : threads)
+		thread.join();
+
+	for (auto &mine : objs) {
+		for (auto p : mine)
+			pool.free(p);
+	}
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+	EXPECT_EQ(slab_policy::mapped_bytes.load(), baseline);
+}
+
+struct page_map_slab_policy : remap_slab_policy {
+	static constexpr bool enable_page_map = true;
+};
+
+TEST(slab, page_map) {
+	page_map_slab_policy policy;
+	frg::slab_pool<page_map_slab_policy, std::mutex> pool{policy};
+
+	std::vector<void *> objs;
+	for (size_t size : {1, 16, 100, 4000, 20000, 1 << 20})
+		objs.push_back(pool.allocate(size));
+	objs.push_back(pool.allocate_aligned(100, 64));
+	objs.push_back(pool.allocate_aligned(5000, 1 << 16));
+
+	int local;
+	auto foreign = std::make_unique<char[]>(64);
+	EXPECT_FALSE(pool.owns(nullptr));
+	EXPECT_FALSE(pool.owns(&local));
+	EXPECT_FALSE(pool.owns(foreign.get()));
+	EXPECT_EQ(pool.get_size(&local), 0);
+	EXPECT_EQ(pool.get_size(foreign.get()), 0);
+
+	for (auto p : objs) {
+		ASSERT_NE(p, nullptr);
+		EXPECT_TRUE(pool.owns(p));
+		EXPECT_GT(pool.get_size(p), 0);
+		// Pointers into objects are not owned.
+		EXPECT_FALSE(pool.owns(static_cast<char *>(p) + 1));
+		EXPECT_EQ(pool.get_size(static_cast<char *>(p) + 1), 0);
+	}
+
+	// The page map follows large objects that are moved by remap().
+	void *large = pool.allocate(1 << 20);
+	void *moved = pool.realloc(large, 8 << 20);
+	ASSERT_NE(moved, nullptr);
+	EXPECT_TRUE(pool.owns(moved));
+	if (moved != large) {
+		EXPECT_FALSE(pool.owns(large));
+	}
+	pool.free(moved);
+	EXPECT_FALSE(pool.owns(moved));
+
+	for (auto p : objs)
+		pool.free(p);
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+	for (auto p : objs)
+		EXPECT_FALSE(pool.owns(p));
+}
+
+struct failing_page_map_slab_policy : page_map_slab_policy {
+	static inline bool fail_maps{false};
+
+	uintptr_t map(size_t size) {
+		if (fail_maps)
+			return 0;
+		return page_map_slab_policy::map(size);
+	}
+};
+
+TEST(slab, page_map_remap_failure) {
+	failing_page_map_slab_policy policy;
+	frg::slab_pool<failing_page_map_slab_policy, std::mutex> pool{policy};
+
+	void *p = pool.allocate(1 << 20);
+	ASSERT_NE(p, nullptr);
+	memset(p, 0x42, 1 << 20);
+
+	// If the page map cannot be extended, remap() is not attempted and realloc() fails cleanly.
+	failing_page_map_slab_policy::fail_maps = true;
+	size_t remaps = remap_slab_policy::num_remaps;
+	EXPECT_EQ(pool.realloc(p, 16 << 20), nullptr);
+	failing_page_map_slab_policy::fail_maps = false;
+	EXPECT_EQ(remap_slab_policy::num_remaps, remaps);
+	EXPECT_TRUE(pool.owns(p));
+	EXPECT_EQ(static_cast<unsigned char *>(p)[(1 << 20) - 1], 0x42);
+
+	void *q = pool.realloc(p, 16 << 20);
+	ASSERT_NE(q, nullptr);
+	EXPECT_TRUE(pool.owns(q));
+	EXPECT_EQ(static_cast<unsigned char *>(q)[(1 << 20) - 1], 0x42);
+
+	// The leaf that remap() did not use is kept, such that remapping works without map().
+	failing_page_map_slab_policy::fail_maps = true;
+	void *r = pool.realloc(q, 1 << 20);
+	failing_page_map_slab_policy::fail_maps = false;
+	ASSERT_NE(r, nullptr);
+	EXPECT_TRUE(pool.owns(r));
+	EXPECT_EQ(static_cast<unsigned char *>(r)[(1 << 20) - 1], 0x42);
+
+	pool.free(r);
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+}
+
+TEST(slab, page_map_threads) {
+	constexpr size_t num_threads = 4;
+	constexpr size_t count = 10000;
+
+	page_map_slab_policy policy;
+	frg::slab_pool<page_map_slab_policy, std::mutex> pool{policy};
+
+	// Lookups do not take locks and run concurrently to allocations and frees.
+	auto run = [&] (size_t t) {
+		std::vector<void *> mine;
+		for (size_t i = 0; i < count; i++) {
+			size_t size = (i % 100) ? 16 << (i % 5) : (64 << 10);
+			void *p = pool.allocate(size);
+			ASSERT_NE(p, nullptr);
+			ASSERT_TRUE(pool.owns(p));
+			mine.push_back(p);
+			if ((i + t) % 3 == 0) {
+				pool.free(mine.front());
+				mine.erase(mine.begin());
+			}
+		}
+		for (auto p : mine) {
+			ASSERT_TRUE(pool.owns(p));
+			pool.free(p);
+		}
+	};
+
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < num_threads; t++)
+		threads.emplace_back(run, t);
+	for (auto &thread : threads)
+		thread.join();
+
+	pool.purge();
+	EXPECT_EQ(pool.numUsedPages(), 0);
+}